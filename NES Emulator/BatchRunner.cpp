@@ -0,0 +1,184 @@
+#include "BatchRunner.h"
+#include "Hash.h"
+
+#include <algorithm>
+
+BatchRunner::BatchRunner(uint32_t nThreads)
+{
+	if (nThreads == 0)
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < nThreads; i++)
+		vQueues.push_back(std::make_unique<sQueue>());
+
+	for (uint32_t i = 0; i < nThreads; i++)
+		vWorkers.emplace_back(&BatchRunner::Worker, this, (size_t)i);
+}
+
+BatchRunner::~BatchRunner()
+{
+	{
+		std::lock_guard<std::mutex> lock(muxRun);
+		bQuit = true;
+	}
+	cvRun.notify_all();
+
+	for (auto& worker : vWorkers)
+		worker.join();
+}
+
+bool BatchRunner::Add(std::shared_ptr<const RomImage> image, uint32_t nSampleRate, bool bCatchUp)
+{
+	auto instance = std::make_unique<sInstance>();
+	instance->cart = std::make_shared<Cartridge>(image);
+	if (!instance->cart->ImageValid())
+		return false;
+
+	instance->nes.insertCartridge(instance->cart);
+	instance->nes.SetCatchUp(bCatchUp);
+	if (nSampleRate > 0)
+		instance->nes.SetSampleFrequency(nSampleRate);
+	instance->nes.reset();
+
+	vInstances.push_back(std::move(instance));
+	return true;
+}
+
+void BatchRunner::ClearOutputs()
+{
+	for (auto& instance : vInstances)
+		instance->output = sOutput();
+}
+
+void BatchRunner::Run(uint32_t nFrames)
+{
+	if (nFrames == 0 || vInstances.empty())
+		return;
+
+	// Deal the consoles out evenly, the workers will sort out
+	// any imbalance between them by stealing
+	for (size_t i = 0; i < vInstances.size(); i++)
+	{
+		vInstances[i]->nFramesLeft = nFrames;
+		sQueue& queue = *vQueues[i % vQueues.size()];
+		std::lock_guard<std::mutex> lock(queue.mux);
+		queue.instances.push_back(vInstances[i].get());
+	}
+
+	std::unique_lock<std::mutex> lock(muxRun);
+	nUnfinished = vInstances.size();
+	nQueued = vInstances.size();
+	nRun++;
+	cvRun.notify_all();
+	cvDone.wait(lock, [&] { return nUnfinished == 0; });
+}
+
+void BatchRunner::Worker(size_t nWorker)
+{
+	uint64_t nLastRun = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(muxRun);
+			cvRun.wait(lock, [&] { return bQuit || nRun != nLastRun; });
+			if (bQuit)
+				return;
+			nLastRun = nRun;
+		}
+
+		while (nUnfinished > 0)
+		{
+			sInstance* instance = Take(nWorker);
+			if (instance == nullptr)
+			{
+				// Everything left is mid-frame on other workers, but
+				// may yet be put back where it can be stolen
+				WaitForWork();
+				continue;
+			}
+
+			RunFrame(*instance);
+
+			if (--instance->nFramesLeft > 0)
+			{
+				{
+					sQueue& queue = *vQueues[nWorker];
+					std::lock_guard<std::mutex> lock(queue.mux);
+					queue.instances.push_front(instance);
+					nQueued++;
+				}
+
+				// Only worth the lock if someone is waiting for it
+				if (nIdle > 0)
+				{
+					std::lock_guard<std::mutex> lock(muxRun);
+					cvQueued.notify_one();
+				}
+			}
+			else if (--nUnfinished == 0)
+			{
+				std::lock_guard<std::mutex> lock(muxRun);
+				cvDone.notify_all();
+				cvQueued.notify_all();
+			}
+		}
+	}
+}
+
+// Sleep until a console is queued or the run is over. A worker becomes idle
+// before looking at the queues again, and one queueing a console counts it
+// before looking for idle workers, so between them one always sees the other.
+void BatchRunner::WaitForWork()
+{
+	std::unique_lock<std::mutex> lock(muxRun);
+	nIdle++;
+	cvQueued.wait(lock, [&] { return nQueued > 0 || nUnfinished == 0; });
+	nIdle--;
+}
+
+BatchRunner::sInstance* BatchRunner::Take(size_t nWorker)
+{
+	// From the front of this worker's own queue first...
+	{
+		sQueue& queue = *vQueues[nWorker];
+		std::lock_guard<std::mutex> lock(queue.mux);
+		if (!queue.instances.empty())
+		{
+			sInstance* instance = queue.instances.front();
+			queue.instances.pop_front();
+			nQueued--;
+			return instance;
+		}
+	}
+
+	// ...otherwise from the back of someone else's
+	for (size_t i = 1; i < vQueues.size(); i++)
+	{
+		sQueue& queue = *vQueues[(nWorker + i) % vQueues.size()];
+		std::lock_guard<std::mutex> lock(queue.mux);
+		if (!queue.instances.empty())
+		{
+			sInstance* instance = queue.instances.back();
+			queue.instances.pop_back();
+			nQueued--;
+			return instance;
+		}
+	}
+
+	return nullptr;
+}
+
+void BatchRunner::RunFrame(sInstance& instance)
+{
+	Bus& nes = instance.nes;
+	sOutput& output = instance.output;
+
+	nes.frame();
+
+	output.nFrames++;
+	output.vFrameHashes.push_back(HashBytes(nes.ppu.GetScreenIndices(), 256 * 240));
+	output.ram = nes.cpuRAM;
+	output.vAudio.insert(output.vAudio.end(), nes.vAudioSamples.begin(), nes.vAudioSamples.end());
+	nes.vAudioSamples.clear();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bus.h"
+#include "RomCache.h"
+
+// Batch Runner
+// Runs many independent consoles at once, across all the host's cores, for
+// regression testing and training. One frame of one console is the unit of
+// work. Each worker thread has its own queue of consoles due a frame, and
+// after running a frame puts that console back on the front of its queue, so
+// a console tends to stay on the core whose cache it is in. A worker with
+// nothing left to do steals from the back of another's queue, so the load
+// evens out however differently the consoles' frames cost. With nothing to
+// steal either, it sleeps until a console is put back on a queue or the run
+// is over, rather than taking a core from the workers still running frames.
+//
+// Thread Safety
+// A console is confined to one thread at a time. Every console has its own
+// Cartridge, mapper and RAM, and the only things shared between consoles are
+// the immutable ROM image, with its decoded pattern tiles, and the ROM
+// cache, which locks itself. A console only moves between threads between frames, and
+// then through a queue's lock, so whichever thread runs its next frame sees
+// everything the last one did. Consoles and their outputs belong to the
+// caller between calls to Run(), and to the workers during it.
+class BatchRunner
+{
+public:
+	// nThreads of 0 uses one per hardware thread
+	BatchRunner(uint32_t nThreads = 0);
+	~BatchRunner();
+
+	BatchRunner(const BatchRunner&) = delete;
+	BatchRunner& operator=(const BatchRunner&) = delete;
+
+	// Add a console running a ROM image, reset and ready to go. Consoles
+	// are numbered in the order they are added. A nSampleRate of 0 produces
+	// no audio. False if the image is not one that can be run.
+	bool Add(std::shared_ptr<const RomImage> image, uint32_t nSampleRate = 0, bool bCatchUp = true);
+	size_t Size() const { return vInstances.size(); }
+
+	// Run every console for nFrames frames, returning once all have
+	void Run(uint32_t nFrames = 1);
+
+	// What each console has produced, collected as it ran
+	struct sOutput
+	{
+		uint64_t nFrames = 0;
+		std::vector<uint64_t> vFrameHashes;	// Of the picture, one per frame run
+		std::array<uint8_t, 2048> ram = { 0x00 }; // CPU RAM as of the last frame run
+		std::vector<float> vAudio;			// Every sample produced
+	};
+
+	const sOutput& Output(size_t nInstance) const { return vInstances[nInstance]->output; }
+	void ClearOutputs();
+
+	// The console itself, e.g. to set its controllers before the next Run()
+	Bus& Console(size_t nInstance) { return vInstances[nInstance]->nes; }
+
+private:
+	struct sInstance
+	{
+		Bus nes;
+		std::shared_ptr<Cartridge> cart;
+		sOutput output;
+		uint32_t nFramesLeft = 0;
+	};
+
+	std::vector<std::unique_ptr<sInstance>> vInstances;
+
+	// Each worker's queue of consoles due a frame
+	struct sQueue
+	{
+		std::mutex mux;
+		std::deque<sInstance*> instances;
+	};
+
+	std::vector<std::unique_ptr<sQueue>> vQueues;
+	std::vector<std::thread> vWorkers;
+
+	// Workers sleep between runs, and are woken by the run number changing
+	std::mutex muxRun;
+	std::condition_variable cvRun;
+	std::condition_variable cvDone;
+	uint64_t nRun = 0;
+	bool bQuit = false;
+	std::atomic<size_t> nUnfinished = { 0 }; // Consoles yet to run all their frames
+
+	// Workers with nothing to take wait for a console to be queued
+	std::condition_variable cvQueued;
+	std::atomic<size_t> nQueued = { 0 }; // Consoles waiting in any queue
+	std::atomic<size_t> nIdle = { 0 }; // Workers waiting on cvQueued
+
+	void Worker(size_t nWorker);
+	sInstance* Take(size_t nWorker);
+	void WaitForWork();
+	void RunFrame(sInstance& instance);
+};
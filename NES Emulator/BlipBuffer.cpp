@@ -0,0 +1,94 @@
+#include <cmath>
+#include <algorithm>
+
+#include "BlipBuffer.h"
+
+BlipBuffer::BlipBuffer()
+{
+	// The impulse each step is made of is a windowed sinc, cut off a little
+	// below the output Nyquist frequency. It is drawn at every phase a step
+	// can have within a sample, each normalised so a step of 1 rises by
+	// exactly KERNEL_UNIT, any rounding going to the centre tap.
+	const double pi = 3.14159265358979323846;
+	const double dCutoff = 0.9;
+	const int nHalf = KERNEL_WIDTH / 2;
+
+	for (int p = 0; p < KERNEL_PHASES; p++)
+	{
+		double dSum = 0.0;
+		double dTaps[KERNEL_WIDTH];
+
+		for (int k = 0; k < KERNEL_WIDTH; k++)
+		{
+			double x = (double)(k - nHalf) - (double)p / KERNEL_PHASES;
+			double s = (x == 0.0) ? 1.0 : std::sin(pi * dCutoff * x) / (pi * dCutoff * x);
+			double w = (std::fabs(x) < nHalf) ? 0.42 + 0.5 * std::cos(pi * x / nHalf) + 0.08 * std::cos(2.0 * pi * x / nHalf) : 0.0;
+			dTaps[k] = s * w;
+			dSum += dTaps[k];
+		}
+
+		int32_t nSum = 0;
+		for (int k = 0; k < KERNEL_WIDTH; k++)
+		{
+			kernel[p][k] = (int32_t)std::lround(dTaps[k] / dSum * KERNEL_UNIT);
+			nSum += kernel[p][k];
+		}
+		kernel[p][nHalf] += KERNEL_UNIT - nSum;
+	}
+}
+
+void BlipBuffer::SetRates(double dClockRate, double dSampleRate, float fStepSize)
+{
+	nSamplesPerClock = (uint64_t)(dSampleRate / dClockRate * 4294967296.0);
+	fLevelScale = fStepSize / KERNEL_UNIT;
+	fHighPassRate = (float)(1.0 - std::exp(-2.0 * 3.14159265358979323846 * 20.0 / dSampleRate));
+
+	nBlockOffset = 0;
+	vDeltas.assign(4096, 0);
+}
+
+void BlipBuffer::AddDelta(uint32_t nClock, int32_t nDelta)
+{
+	if (nSamplesPerClock == 0)
+		return;
+
+	uint64_t nPos = nBlockOffset + nClock * nSamplesPerClock;
+	size_t nSample = (size_t)(nPos >> 32);
+	int nPhase = (int)((nPos >> (32 - 6)) & (KERNEL_PHASES - 1));
+
+	if (nSample + KERNEL_WIDTH > vDeltas.size())
+		vDeltas.resize(std::max(vDeltas.size() * 2, nSample + KERNEL_WIDTH), 0);
+
+	int32_t* pOut = &vDeltas[nSample];
+	const int32_t* pKernel = kernel[nPhase];
+	for (int k = 0; k < KERNEL_WIDTH; k++)
+		pOut[k] += pKernel[k] * nDelta;
+}
+
+void BlipBuffer::EndBlock(uint32_t nClocks, std::vector<float>& vOut)
+{
+	if (nSamplesPerClock == 0)
+		return;
+
+	uint64_t nPos = nBlockOffset + nClocks * nSamplesPerClock;
+	size_t nSamples = (size_t)(nPos >> 32);
+	nBlockOffset = nPos & 0xFFFFFFFF;
+
+	if (nSamples + KERNEL_WIDTH > vDeltas.size())
+		vDeltas.resize(nSamples + KERNEL_WIDTH, 0);
+
+	for (size_t i = 0; i < nSamples; i++)
+	{
+		nLevel += vDeltas[i];
+		float fLevel = (float)nLevel * fLevelScale;
+		fHighPass += (fLevel - fHighPass) * fHighPassRate;
+		vOut.push_back(fLevel - fHighPass);
+	}
+
+	// Steps near the end of the block reach into the next one
+	if (nSamples > 0)
+	{
+		std::copy(vDeltas.begin() + nSamples, vDeltas.begin() + nSamples + KERNEL_WIDTH, vDeltas.begin());
+		std::fill(vDeltas.begin() + KERNEL_WIDTH, vDeltas.begin() + nSamples + KERNEL_WIDTH, 0);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Band-limited Step Synthesis
+// The APU's channels are made of nothing but steps, a level held until it
+// jumps to another. Rather than sampling that and aliasing horribly, each
+// jump is recorded as a delta at the exact clock it happens on, drawn into
+// the buffer as a band-limited step at whatever sample the clock lands on.
+// Summing the buffer then gives the band-limited signal at the output rate.
+// Work is only done when something changes, and once per output sample.
+//
+// Deltas are whole numbers of a fixed step size, and are drawn with a kernel
+// of fixed point taps, so the buffer is summed exactly. However the steps of
+// several channels are interleaved in adding them, the output is the same.
+class BlipBuffer
+{
+public:
+	BlipBuffer();
+
+	// Clocks are counted from the start of the current block, and a delta
+	// of 1 is a step of fStepSize in the output
+	void SetRates(double dClockRate, double dSampleRate, float fStepSize);
+	void AddDelta(uint32_t nClock, int32_t nDelta);
+
+	// Finish the block after this many clocks, appending every sample now
+	// complete to vOut. The next block starts where this one ends.
+	void EndBlock(uint32_t nClocks, std::vector<float>& vOut);
+
+	bool Enabled() const { return nSamplesPerClock != 0; }
+
+private:
+	// Each step is spread across this many samples, and the output is
+	// delayed by half of that so steps can be drawn either side of the
+	// sample they land on
+	static constexpr int KERNEL_WIDTH = 16;
+	static constexpr int KERNEL_PHASES = 64;
+	static constexpr int KERNEL_UNIT = 1 << 16; // The taps of each phase sum to this
+	int32_t kernel[KERNEL_PHASES][KERNEL_WIDTH];
+
+	std::vector<int32_t> vDeltas; // One per sample from the start of the block
+	uint64_t nSamplesPerClock = 0; // 32.32 fixed point
+	uint64_t nBlockOffset = 0; // Fraction of a sample the block starts part way through
+
+	// Integration, with a high pass filter to remove any DC
+	int64_t nLevel = 0;
+	float fLevelScale = 0.0f; // Output per unit of nLevel
+	float fHighPass = 0.0f;
+	float fHighPassRate = 0.0f;
+};
@@ -1,82 +1,34 @@
 #include "Cartridge.h"
 
-Cartridge::Cartridge(const std::string& sFileName)
-{
-	// iNES Format Header
-	struct sHeader
-	{
-		char name[4];
-		uint8_t prg_rom_chunks;
-		uint8_t chr_rom_chunks;
-		uint8_t mapper1;
-		uint8_t mapper2;
-		uint8_t prg_ram_size;
-		uint8_t tv_system1;
-		uint8_t tv_system2;
-		char unused[5];
-	} header;
+Cartridge::Cartridge(const std::string& sFileName) : Cartridge(RomCache::Load(sFileName))
+{
+}
 
+Cartridge::Cartridge(std::shared_ptr<const RomImage> image)
+{
 	bImageValid = false;
 
-	std::ifstream ifs;
-	ifs.open(sFileName, std::ifstream::binary);
+	// ROM is never written, so rather than a copy of it for every cartridge,
+	// PRG and CHR ROM are read straight out of the shared image
+	pImage = image;
 
-	if (ifs.is_open())
+	if (pImage != nullptr)
 	{
-		// Read File Header
-		ifs.read((char*)&header, sizeof(sHeader));
-
-		// Skip Training Data
-		if (header.mapper1 & 0x04)
-		{
-			ifs.seekg(512, std::ios_base::cur);
-		}
-
-		// Determine Mapper ID
-		nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
-		hw_mirror = (header.mapper1 & 0x01) ? VERTICAL : HORIZONTAL;
-	
-		// Discover file format
-		uint8_t nFileType = 1;
-
-		if ((header.mapper2 & 0x0C) == 0x08) nFileType = 2;
+		nMapperID = pImage->nMapperID;
+		nPRGBanks = pImage->nPRGBanks;
+		nCHRBanks = pImage->nCHRBanks;
+		hw_mirror = pImage->hw_mirror;
 
-		if (nFileType == 0)
+		if (nCHRBanks == 0)
 		{
-
-		}
-
-		if (nFileType == 1)
-		{
-			nPRGBanks = header.prg_rom_chunks;
-			vPRGMemory.resize(nPRGBanks * 16384);
-			ifs.read((char*)vPRGMemory.data(), vPRGMemory.size());
-
-			nCHRBanks = header.chr_rom_chunks;
-
-			if (nCHRBanks == 0)
-			{
-				// Create CHR RAM
-				vCHRMemory.resize(8192);
-			}
-			else
-			{
-				// Allocate for ROM
-				vCHRMemory.resize(nCHRBanks * 8192);
-			}
-
-			ifs.read((char*)vCHRMemory.data(), vCHRMemory.size());
+			// Create CHR RAM, which each cartridge needs its own of
+			vCHRRAM.resize(8192);
 		}
 
-		if (nFileType == 2)
+		if (hw_mirror == MIRROR::FOURSCREEN)
 		{
-			nPRGBanks = ((header.prg_ram_size & 0x07) << 8) | header.prg_rom_chunks;
-			vPRGMemory.resize(nPRGBanks * 16384);
-			ifs.read((char*)vPRGMemory.data(), vPRGMemory.size());
-
-			nCHRBanks = ((header.prg_ram_size & 0x38) << 8) | header.chr_rom_chunks;
-			vCHRMemory.resize(nCHRBanks * 8192);
-			ifs.read((char*)vCHRMemory.data(), vCHRMemory.size());
+			// The two nametables the console doesn't have
+			vVRAM.resize(2048);
 		}
 
 		// Load Appropriate Mapper
@@ -101,9 +53,42 @@ Cartridge::Cartridge(const std::string& sFileName)
 			pMapper = std::make_shared<Mapper_066>(nPRGBanks, nCHRBanks);
 			break;
 		}
-		
-		bImageValid = true;
-		ifs.close();
+
+		// The mapper switches banks of the image and CHR RAM. ROM is only
+		// ever read through the windows it sets up, the CPU's writes going
+		// to the mapper and the PPU's only where pattern memory is RAM.
+		// Without a mapper there is nothing to run, and the image is not valid.
+		if (pMapper != nullptr)
+		{
+			if (vCHRRAM.empty())
+			{
+				pMapper->connectMemory(const_cast<uint8_t*>(pImage->pPRGMemory), pImage->nPRGSize, const_cast<uint8_t*>(pImage->pCHRMemory), pImage->nCHRSize);
+			}
+			else
+			{
+				pMapper->connectMemory(const_cast<uint8_t*>(pImage->pPRGMemory), pImage->nPRGSize, vCHRRAM.data(), vCHRRAM.size());
+				tiles.Connect(vCHRRAM.data(), vCHRRAM.size());
+			}
+
+			bImageValid = true;
+		}
+	}
+}
+
+bool Cartridge::SupportsMapper(uint8_t nMapperID)
+{
+	// The mappers the constructor can make
+	switch (nMapperID)
+	{
+	case 0:
+	case 1:
+	case 2:
+	case 3:
+	case 4:
+	case 66:
+		return true;
+	default:
+		return false;
 	}
 }
 
@@ -118,25 +103,17 @@ bool Cartridge::ImageValid()
 
 bool Cartridge::cpuRead(uint16_t addr, uint8_t &data)
 {
-	uint32_t mapped_addr = 0;
-
-	if (pMapper->cpuMapRead(addr, mapped_addr, data))
+	if (addr >= 0x8000)
 	{
-		if (mapped_addr == 0xFFFFFFFF)
-		{
-			// Mapper has actually set the data value, for example cartridge based RAM
-			return true;
-		}
-		else
-		{
-			// Mapper has produced an offset into cartridge bank memory
-			data = vPRGMemory[mapped_addr];
-		}
+		// PRG ROM, through whichever bank the mapper has in this window
+		data = pMapper->pPRGBank[(addr >> 13) & 0x03][addr & 0x1FFF];
 		return true;
 	}
-	else
+	else if (addr >= 0x6000 && pMapper->pPRGRAM != nullptr)
 	{
-		return false;
+		// Cartridge based RAM
+		data = pMapper->pPRGRAM[addr & 0x1FFF];
+		return true;
 	}
 
 	return false;
@@ -144,42 +121,65 @@ bool Cartridge::cpuRead(uint16_t addr, uint8_t &data)
 
 bool Cartridge::cpuWrite(uint16_t addr, uint8_t data)
 {
-	uint32_t mapped_addr = 0;
-
-	if (pMapper->cpuMapWrite(addr, mapped_addr, data))
+	if (addr >= 0x8000)
 	{
-		if (mapped_addr == 0xFFFFFFFF)
-		{
-			// Mapper has actually set the data value, for example cartridge based RAM
-			return true;
-		}
-		else
-		{
-			// Mapper has produced an offset into cartridge bank memory
-			vPRGMemory[mapped_addr] = data;
-		}
+		// ROM can not be written, but the mapper may have registers here
+		pMapper->cpuMapWrite(addr, data);
 		return true;
 	}
-	else
+	else if (addr >= 0x6000 && pMapper->pPRGRAM != nullptr)
 	{
-		return false;
+		// Cartridge based RAM
+		pMapper->pPRGRAM[addr & 0x1FFF] = data;
+		return true;
 	}
 
 	return false;
 }
 
-bool Cartridge::ppuRead(uint16_t addr, uint8_t &data)
+void Cartridge::cpuMapPages(uint8_t* pReadPages[256], uint8_t* pWritePages[256])
 {
-	uint32_t mapped_addr = 0;
+	for (uint32_t page = 0x60; page <= 0x7F; page++)
+	{
+		uint8_t* pPage = pMapper->pPRGRAM ? pMapper->pPRGRAM + ((page & 0x1F) << 8) : nullptr;
+		pReadPages[page] = pPage;
+		pWritePages[page] = pPage;
+	}
 
-	if (pMapper->ppuMapRead(addr, mapped_addr))
+	// ROM pages are only read directly, writes must reach the mapper
+	for (uint32_t page = 0x80; page <= 0xFF; page++)
 	{
-		data = vCHRMemory[mapped_addr];
-		return true;
+		pReadPages[page] = pMapper->pPRGBank[(page >> 5) & 0x03] + ((page & 0x1F) << 8);
+		pWritePages[page] = nullptr;
+	}
+}
+
+bool Cartridge::cpuMapChanged()
+{
+	return pMapper->prgMapChanged();
+}
+
+const TileCache::sRow* const* Cartridge::ppuMapTiles()
+{
+	if (pMapper->bCHRWritable)
+	{
+		for (int i = 0; i < 8; i++)
+			pTileBank[i] = tiles.Bank(pMapper->pCHRBank[i]);
 	}
 	else
 	{
-		return false;
+		for (int i = 0; i < 8; i++)
+			pTileBank[i] = pImage->tiles.Decoded(pMapper->pCHRBank[i]);
+	}
+	return pTileBank;
+}
+
+bool Cartridge::ppuRead(uint16_t addr, uint8_t &data)
+{
+	if (addr <= 0x1FFF)
+	{
+		data = pMapper->pCHRBank[addr >> 10][addr & 0x03FF];
+		return true;
 	}
 
 	return false;
@@ -187,17 +187,16 @@ bool Cartridge::ppuRead(uint16_t addr, uint8_t &data)
 
 bool Cartridge::ppuWrite(uint16_t addr, uint8_t data)
 {
-	uint32_t mapped_addr = 0;
-
-	if (pMapper->ppuMapWrite(addr, mapped_addr))
+	if (addr <= 0x1FFF)
 	{
-		vCHRMemory[mapped_addr] = data;
+		// Pattern memory is only writable if it is RAM
+		if (pMapper->bCHRWritable)
+		{
+			pMapper->pCHRBank[addr >> 10][addr & 0x03FF] = data;
+			tiles.Invalidate(pMapper->pCHRBank[addr >> 10]);
+		}
 		return true;
 	}
-	else
-	{
-		return false;
-	}
 
 	return false;
 }
@@ -213,6 +212,11 @@ void Cartridge::reset()
 
 MIRROR Cartridge::Mirror()
 {
+	// Four screen boards wire the nametables up themselves, whatever the
+	// mapper has been asked for
+	if (hw_mirror == MIRROR::FOURSCREEN)
+		return hw_mirror;
+
 	MIRROR m = pMapper->mirror();
 	
 	if (m == MIRROR::HARDWARE)
@@ -225,7 +229,63 @@ MIRROR Cartridge::Mirror()
 	}
 }
 
+bool Cartridge::mirrorChanged()
+{
+	MIRROR m = Mirror();
+	bool bChanged = m != nMirror;
+	nMirror = m;
+	return bChanged;
+}
+
+uint8_t* Cartridge::ppuVRAM()
+{
+	return vVRAM.empty() ? nullptr : vVRAM.data();
+}
+
 std::shared_ptr<Mapper> Cartridge::GetMapper()
 {
 	return pMapper;
-}
\ No newline at end of file
+}
+
+std::shared_ptr<const RomImage> Cartridge::GetImage()
+{
+	return pImage;
+}
+
+void Cartridge::saveState(StateWriter& state) const
+{
+	state.Write(nMapperID);
+	state.Write(nPRGBanks);
+	state.Write(nCHRBanks);
+
+	if (pMapper->bCHRWritable)
+		state.Write(vCHRRAM.data(), vCHRRAM.size());
+
+	if (!vVRAM.empty())
+		state.Write(vVRAM.data(), vVRAM.size());
+
+	pMapper->saveState(state);
+}
+
+bool Cartridge::loadState(StateReader& state)
+{
+	uint8_t nID = 0, nPRG = 0, nCHR = 0;
+	state.Read(nID);
+	state.Read(nPRG);
+	state.Read(nCHR);
+
+	if (nID != nMapperID || nPRG != nPRGBanks || nCHR != nCHRBanks)
+		return false;
+
+	if (pMapper->bCHRWritable)
+	{
+		state.Read(vCHRRAM.data(), vCHRRAM.size());
+		tiles.InvalidateAll();
+	}
+
+	if (!vVRAM.empty())
+		state.Read(vVRAM.data(), vVRAM.size());
+
+	pMapper->loadState(state);
+	return true;
+}
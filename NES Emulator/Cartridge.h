@@ -3,8 +3,10 @@
 #include <cstdint>
 #include <string>
 #include <vector>
-#include <fstream>
+#include <memory>
 
+#include "RomCache.h"
+#include "TileCache.h"
 #include "Mapper_000.h"
 #include "Mapper_001.h"
 #include "Mapper_002.h"
@@ -16,6 +18,7 @@ class Cartridge
 {
 public:
 	Cartridge(const std::string& sFileName);
+	Cartridge(std::shared_ptr<const RomImage> image);
 	~Cartridge();
 
 	// Communications with Main Bus
@@ -26,11 +29,42 @@ public:
 	bool		ppuRead(uint16_t addr, uint8_t &data);
 	bool		ppuWrite(uint16_t addr, uint8_t data);
 
+	// Direct CPU memory map. Points the pages of CPU address space from
+	// 0x6000 upwards at the PRG memory the mapper has there, or nullptr where
+	// the access needs handling. Valid until cpuMapChanged() next returns true.
+	void		cpuMapPages(uint8_t* pReadPages[256], uint8_t* pWritePages[256]);
+	bool		cpuMapChanged();
+
+	// Decoded PPU pattern memory map, the decoded rows of each 1KB of
+	// 0x0000 - 0x1FFF. Valid until the next write to a mapper register or
+	// to pattern memory.
+	const TileCache::sRow* const* ppuMapTiles();
+
+	// Nametable VRAM on the cartridge, 2KB for 0x2800 - 0x2FFF if the
+	// mirroring is FOURSCREEN, otherwise nullptr
+	uint8_t*	ppuVRAM();
+
 	bool ImageValid();
+
+	// Whether a cartridge can be made for ROMs with this iNES mapper number
+	static bool SupportsMapper(uint8_t nMapperID);
 	void reset();
 	MIRROR Mirror();
 
+	// Returns true, once, when Mirror() would return something other than
+	// it did when last asked here. Only mapper registers and save states
+	// can change it.
+	bool mirrorChanged();
+
 	std::shared_ptr<Mapper> GetMapper();
+	std::shared_ptr<const RomImage> GetImage();
+
+	// Save States
+	// The mapper's state, and pattern and nametable memory if the cartridge
+	// has RAM for them. A state can only
+	// be loaded into the same kind of cartridge it was saved from.
+	void saveState(StateWriter& state) const;
+	bool loadState(StateReader& state);
 
 	//enum MIRROR
 	//{
@@ -41,8 +75,18 @@ public:
 	//} mirror = HORIZONTAL;
 
 private:
-	std::vector<uint8_t> vPRGMemory;
-	std::vector<uint8_t> vCHRMemory;
+	// The ROM, shared with every other cartridge made from it
+	std::shared_ptr<const RomImage> pImage;
+
+	// Pattern memory, if the cartridge has RAM rather than ROM
+	std::vector<uint8_t> vCHRRAM;
+
+	// Nametable memory, if the cartridge has its own
+	std::vector<uint8_t> vVRAM;
+
+	// Pattern RAM decoded. Pattern ROM is decoded in the shared image.
+	TileCache tiles;
+	const TileCache::sRow* pTileBank[8] = { nullptr };
 
 	uint8_t nMapperID = 0;
 	uint8_t nPRGBanks = 0;
@@ -53,5 +97,6 @@ private:
 	bool bImageValid = false;
 
 	MIRROR hw_mirror = HORIZONTAL;
+	MIRROR nMirror = HARDWARE; // As last returned by mirrorChanged()
 };
 
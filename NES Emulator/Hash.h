@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// SSE2 is always there on x64, elsewhere the lanes are simply a loop
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_SIMD_SSE2
+#endif
+
+// Hashing
+// A fast 64-bit hash of blocks of memory, for telling ROMs, frames and states
+// apart, and cheap enough to run over every frame without showing up in how
+// fast the emulation runs. Not for anything that has to withstand deliberate
+// collisions. It is built the way xxHash3 is, though it does not give the
+// same values: the input is taken 64 bytes at a time into eight 64-bit
+// accumulators, each adding the product of the two 32-bit halves of its word
+// mixed with a key, plus the neighbouring word unmixed. Two accumulators fit
+// in a vector register, so that is a handful of instructions per 16 bytes.
+// Every 1KB the accumulators are scrambled so that no input can cancel out
+// what came before, and at the end they are folded down into one and mixed.
+//
+// A Hasher takes its input in any number of pieces, and gives the same hash
+// as the whole input given to HashBytes() at once.
+class Hasher
+{
+public:
+	Hasher(uint64_t nSeed = 0)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			key[i] = nKey[i] + ((i & 1) ? 0 - nSeed : nSeed);
+			acc[i] = nInit[i];
+		}
+	}
+
+	Hasher& Update(const void* pData, size_t nSize)
+	{
+		const uint8_t* p = (const uint8_t*)pData;
+		nTotal += nSize;
+
+		// Top up a partly filled stripe first
+		if (nBuffered > 0)
+		{
+			size_t n = nSize < 64 - nBuffered ? nSize : 64 - nBuffered;
+			std::memcpy(buffer + nBuffered, p, n);
+			nBuffered += n;
+			p += n;
+			nSize -= n;
+			if (nBuffered < 64)
+				return *this;
+
+			Stripe(buffer);
+			nBuffered = 0;
+		}
+
+		for (; nSize >= 64; p += 64, nSize -= 64)
+			Stripe(p);
+
+		std::memcpy(buffer, p, nSize);
+		nBuffered = nSize;
+		return *this;
+	}
+
+	template <typename T>
+	Hasher& Update(const T& v)
+	{
+		return Update(&v, sizeof(T));
+	}
+
+	uint64_t Digest() const
+	{
+		// The last partial stripe, padded out with zeros, on a copy so
+		// more can still be added afterwards
+		Hasher h = *this;
+		if (h.nBuffered > 0)
+		{
+			std::memset(h.buffer + h.nBuffered, 0, 64 - h.nBuffered);
+			h.Stripe(h.buffer);
+		}
+
+		uint64_t r = nTotal * nPrime[0];
+		for (int i = 0; i < 8; i += 2)
+			r = Mix(r ^ Fold(h.acc[i] ^ h.key[i], h.acc[i + 1] ^ h.key[i + 1]));
+
+		return Avalanche(r);
+	}
+
+private:
+	static constexpr uint64_t nPrime[3] = { 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL };
+	static constexpr uint64_t nKey[8] = {
+		0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+		0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL, 0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL };
+	static constexpr uint64_t nInit[8] = {
+		0x00000000C2B2AE3DULL, 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL,
+		0x85EBCA77C2B2AE63ULL, 0x0000000085EBCA77ULL, 0x27D4EB2F165667C5ULL, 0x000000009E3779B1ULL };
+
+	uint64_t acc[8];
+	uint64_t key[8];
+	uint8_t buffer[64];
+	size_t nBuffered = 0;
+	uint64_t nTotal = 0;
+	uint32_t nStripes = 0;
+
+	void Stripe(const uint8_t* p)
+	{
+#ifdef HASH_SIMD_SSE2
+		for (int i = 0; i < 8; i += 2)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i*)(p + i * 8));
+			__m128i k = _mm_loadu_si128((const __m128i*)(key + i));
+			__m128i a = _mm_loadu_si128((const __m128i*)(acc + i));
+			__m128i dk = _mm_xor_si128(d, k);
+			a = _mm_add_epi64(a, _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32)));
+			a = _mm_add_epi64(a, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+			_mm_storeu_si128((__m128i*)(acc + i), a);
+		}
+#else
+		for (int i = 0; i < 8; i++)
+		{
+			uint64_t d, n;
+			std::memcpy(&d, p + i * 8, 8);
+			std::memcpy(&n, p + (i ^ 1) * 8, 8);
+			uint64_t dk = d ^ key[i];
+			acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32) + n;
+		}
+#endif
+
+		if (++nStripes % 16 == 0)
+		{
+			for (int i = 0; i < 8; i++)
+				acc[i] = ((acc[i] ^ (acc[i] >> 47)) ^ key[i]) * 0x9E3779B1ULL;
+		}
+	}
+
+	// The upper and lower halves of the full 128-bit product, combined
+	static uint64_t Fold(uint64_t a, uint64_t b)
+	{
+		uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+		uint64_t hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+		uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+		uint64_t hi_hi = (a >> 32) * (b >> 32);
+		uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+		uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+		uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+		return upper ^ lower;
+	}
+
+	static uint64_t Mix(uint64_t h)
+	{
+		return ((h << 27) | (h >> 37)) * nPrime[0] + nPrime[2];
+	}
+
+	static uint64_t Avalanche(uint64_t h)
+	{
+		h ^= h >> 37;
+		h *= nPrime[1];
+		h ^= h >> 32;
+		return h;
+	}
+};
+
+inline uint64_t HashBytes(const void* pData, size_t nSize, uint64_t nSeed = 0)
+{
+	return Hasher(nSeed).Update(pData, nSize).Digest();
+}
@@ -0,0 +1,102 @@
+#include "InputMovie.h"
+
+#include <fstream>
+#include <iterator>
+
+bool InputMovie::Start(Bus& nes) const
+{
+	return vStartState.empty() || nes.loadState(vStartState);
+}
+
+bool InputMovie::Apply(Bus& nes, size_t nFrame) const
+{
+	if (nFrame >= vFrames.size())
+		return false;
+
+	const sFrame& frame = vFrames[nFrame];
+	if (frame.flags & RESET)
+		nes.reset();
+
+	nes.controller[0] = frame.controller[0];
+	nes.controller[1] = frame.controller[1];
+	return true;
+}
+
+bool InputMovie::Save(const std::string& sFileName) const
+{
+	std::vector<uint8_t> vData;
+	StateWriter movie(vData);
+
+	movie.Write(nMagic);
+	movie.Write(nVersion);
+	movie.Write(nRomHash);
+	movie.Write((uint32_t)vStartState.size());
+	movie.Write(vStartState.data(), vStartState.size());
+	movie.Write((uint32_t)vFrames.size());
+
+	// Runs of the same input, as a count then the frame
+	for (size_t i = 0; i < vFrames.size(); )
+	{
+		uint32_t nRun = 1;
+		while (i + nRun < vFrames.size() && vFrames[i + nRun] == vFrames[i])
+			nRun++;
+
+		movie.Write(nRun);
+		movie.Write(vFrames[i].controller[0]);
+		movie.Write(vFrames[i].controller[1]);
+		movie.Write(vFrames[i].flags);
+		i += nRun;
+	}
+
+	std::ofstream ofs(sFileName, std::ofstream::binary);
+	ofs.write((const char*)vData.data(), vData.size());
+	return ofs.good();
+}
+
+bool InputMovie::Load(const std::string& sFileName)
+{
+	std::ifstream ifs(sFileName, std::ifstream::binary);
+	if (!ifs.is_open())
+		return false;
+
+	std::vector<uint8_t> vData((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	StateReader movie(vData.data(), vData.size());
+
+	uint32_t nFileMagic = 0, nFileVersion = 0, nStateSize = 0, nFrames = 0;
+	uint64_t nHash = 0;
+	movie.Read(nFileMagic);
+	movie.Read(nFileVersion);
+	movie.Read(nHash);
+	movie.Read(nStateSize);
+	if (movie.Failed() || nFileMagic != nMagic || nFileVersion != nVersion || nStateSize > vData.size())
+		return false;
+
+	std::vector<uint8_t> vState(nStateSize);
+	movie.Read(vState.data(), vState.size());
+	movie.Read(nFrames);
+	if (movie.Failed())
+		return false;
+
+	std::vector<sFrame> vLoaded;
+	while (vLoaded.size() < nFrames)
+	{
+		uint32_t nRun = 0;
+		sFrame frame;
+		movie.Read(nRun);
+		movie.Read(frame.controller[0]);
+		movie.Read(frame.controller[1]);
+		movie.Read(frame.flags);
+		if (movie.Failed() || nRun == 0 || nRun > nFrames - vLoaded.size())
+			return false;
+
+		vLoaded.insert(vLoaded.end(), nRun, frame);
+	}
+
+	if (!movie.AtEnd())
+		return false;
+
+	nRomHash = nHash;
+	vStartState.swap(vState);
+	vFrames.swap(vLoaded);
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bus.h"
+
+// Input Movies
+// The console is deterministic, so everything it does from power on follows
+// from the ROM and what is done to it from outside, which is only ever the
+// two controllers and the reset button. A movie is that, one entry per frame,
+// so replaying it reproduces the run exactly, picture and sound, for a tiny
+// fraction of the space a recording of either would take. The ROM it was
+// recorded on is identified by its hash, as in the ROM cache.
+//
+// A movie starts from a console freshly reset with the cartridge inserted,
+// or, if it was recorded partway through a run, from the save state of the
+// console at the start, as resetting does not clear RAM or the APU. Each
+// frame, any reset is done first, then the controllers are set, then the
+// frame is run. On disk, runs of identical frames are stored once with a
+// count, as input is mostly held for many frames at a time.
+class InputMovie
+{
+public:
+	enum FLAGS : uint8_t
+	{
+		RESET = (1 << 0), // Reset before the frame
+	};
+
+	struct sFrame
+	{
+		uint8_t controller[2] = { 0x00, 0x00 };
+		uint8_t flags = 0x00;
+
+		bool operator==(const sFrame& f) const
+		{
+			return controller[0] == f.controller[0] && controller[1] == f.controller[1] && flags == f.flags;
+		}
+	};
+
+	InputMovie(uint64_t nRomHash = 0) : nRomHash(nRomHash) {}
+
+	uint64_t RomHash() const { return nRomHash; }
+	size_t Frames() const { return vFrames.size(); }
+	const sFrame& Frame(size_t nFrame) const { return vFrames[nFrame]; }
+
+	// Where the movie starts from, none for power on
+	void SetStartState(std::vector<uint8_t> vState) { vStartState = std::move(vState); }
+	const std::vector<uint8_t>& StartState() const { return vStartState; }
+
+	// Add the next frame's input
+	void Record(const sFrame& frame) { vFrames.push_back(frame); }
+	void Clear() { vFrames.clear(); vStartState.clear(); }
+
+	// Put a freshly reset console where the movie starts. False if the
+	// start state can not be loaded into it.
+	bool Start(Bus& nes) const;
+
+	// Give the console a frame's input, ready for it to run the frame.
+	// False, leaving the console alone, past the end of the movie.
+	bool Apply(Bus& nes, size_t nFrame) const;
+
+	bool Save(const std::string& sFileName) const;
+	bool Load(const std::string& sFileName);
+
+private:
+	static constexpr uint32_t nMagic = 0x4D53454E; // "NESM"
+	static constexpr uint32_t nVersion = 1;
+
+	uint64_t nRomHash = 0;
+	std::vector<uint8_t> vStartState;
+	std::vector<sFrame> vFrames;
+};
@@ -0,0 +1,835 @@
+#include "LockstepCPU.h"
+#include "OpcodeTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "olc6502.h"
+
+// Operations are done 16 lanes at a time. SSE2 is always there on x64,
+// elsewhere each vector is simply a loop over its lanes.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOCKSTEP_SIMD_SSE2
+#endif
+
+namespace
+{
+	// 16 lanes of bytes. Comparisons give 0xFF in lanes where they hold.
+#ifdef LOCKSTEP_SIMD_SSE2
+	struct V16
+	{
+		__m128i v;
+
+		static V16 load(const uint8_t* p) { return { _mm_loadu_si128((const __m128i*)p) }; }
+		static V16 set(uint8_t n) { return { _mm_set1_epi8((char)n) }; }
+		void store(uint8_t* p) const { _mm_storeu_si128((__m128i*)p, v); }
+	};
+
+	inline V16 operator&(V16 a, V16 b) { return { _mm_and_si128(a.v, b.v) }; }
+	inline V16 operator|(V16 a, V16 b) { return { _mm_or_si128(a.v, b.v) }; }
+	inline V16 operator^(V16 a, V16 b) { return { _mm_xor_si128(a.v, b.v) }; }
+	inline V16 operator+(V16 a, V16 b) { return { _mm_add_epi8(a.v, b.v) }; }
+	inline V16 operator-(V16 a, V16 b) { return { _mm_sub_epi8(a.v, b.v) }; }
+	inline V16 andnot(V16 a, V16 b) { return { _mm_andnot_si128(a.v, b.v) }; } // ~a & b
+	inline V16 eq(V16 a, V16 b) { return { _mm_cmpeq_epi8(a.v, b.v) }; }
+	inline V16 max(V16 a, V16 b) { return { _mm_max_epu8(a.v, b.v) }; }
+	inline V16 shr1(V16 a) { return { _mm_and_si128(_mm_srli_epi16(a.v, 1), _mm_set1_epi8(0x7F)) }; }
+	inline V16 select(V16 m, V16 a, V16 b) { return { _mm_or_si128(_mm_and_si128(m.v, a.v), _mm_andnot_si128(m.v, b.v)) }; }
+	inline bool any(V16 m) { return _mm_movemask_epi8(m.v) != 0; }
+#else
+	struct V16
+	{
+		uint8_t v[16];
+
+		static V16 load(const uint8_t* p) { V16 r; std::memcpy(r.v, p, 16); return r; }
+		static V16 set(uint8_t n) { V16 r; std::memset(r.v, n, 16); return r; }
+		void store(uint8_t* p) const { std::memcpy(p, v, 16); }
+	};
+
+	template <typename F>
+	inline V16 each(V16 a, V16 b, F f) { V16 r; for (int i = 0; i < 16; i++) r.v[i] = (uint8_t)f(a.v[i], b.v[i]); return r; }
+
+	inline V16 operator&(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return p & q; }); }
+	inline V16 operator|(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return p | q; }); }
+	inline V16 operator^(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return p ^ q; }); }
+	inline V16 operator+(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return p + q; }); }
+	inline V16 operator-(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return p - q; }); }
+	inline V16 andnot(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return ~p & q; }); }
+	inline V16 eq(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return p == q ? 0xFF : 0x00; }); }
+	inline V16 max(V16 a, V16 b) { return each(a, b, [](uint8_t p, uint8_t q) { return std::max(p, q); }); }
+	inline V16 shr1(V16 a) { return each(a, a, [](uint8_t p, uint8_t) { return p >> 1; }); }
+	inline V16 select(V16 m, V16 a, V16 b) { return (m & a) | andnot(m, b); }
+	inline bool any(V16 m) { for (int i = 0; i < 16; i++) if (m.v[i]) return true; return false; }
+#endif
+
+	const uint8_t C = olc6502::C;
+	const uint8_t Z = olc6502::Z;
+	const uint8_t I = olc6502::I;
+	const uint8_t D = olc6502::D;
+	const uint8_t B = olc6502::B;
+	const uint8_t U = olc6502::U;
+	const uint8_t V = olc6502::V;
+	const uint8_t N = olc6502::N;
+
+	// The Z and N flags for a result
+	inline V16 FlagsNZ(V16 r)
+	{
+		return (eq(r, V16::set(0x00)) & V16::set(Z)) | (r & V16::set(N));
+	}
+
+	// Replace some of the status flags, in the lanes in the mask
+	inline void SetFlags(uint8_t* pStatus, V16 m, uint8_t nFlags, V16 flags)
+	{
+		V16 s = V16::load(pStatus);
+		select(m, (s & V16::set((uint8_t)~nFlags)) | flags, s).store(pStatus);
+	}
+
+	inline void SetReg(uint8_t* pReg, V16 m, V16 r)
+	{
+		select(m, r, V16::load(pReg)).store(pReg);
+	}
+}
+
+const LockstepCPU::INSTRUCTION LockstepCPU::lookup[256] =
+{
+#define X(operate, addrmode, cycles, name) { operate, addrmode, cycles },
+	OPCODE_TABLE_6502(X)
+#undef X
+};
+
+LockstepCPU::LockstepCPU(std::shared_ptr<const RomImage> image, size_t nLanes, IO* pIO)
+	: pIO(pIO), nLanes(nLanes)
+{
+	// Only ROM with nothing in the way of it can be shared by every lane
+	if (image == nullptr || image->nMapperID != 0 || image->nPRGSize == 0)
+		return;
+
+	pImage = image;
+	nStride = (nLanes + 15) & ~(size_t)15;
+
+	accumulator.assign(nStride, 0x00);
+	x.assign(nStride, 0x00);
+	y.assign(nStride, 0x00);
+	stkp.assign(nStride, 0x00);
+	pc.assign(nStride, 0x0000);
+	status.assign(nStride, 0x00);
+	cycles.assign(nStride, 0);
+	controller[0].assign(nStride, 0x00);
+	controller[1].assign(nStride, 0x00);
+	controller_state[0].assign(nStride, 0x00);
+	controller_state[1].assign(nStride, 0x00);
+	vRAM.assign(2048 * nStride, 0x00);
+
+	vEligible.assign(nStride, 0x00);
+	vMask.assign(nStride, 0x00);
+	vMask16.assign(nStride, 0x0000);
+	vMask32.assign(nStride, 0);
+	vAddr.assign(nStride, 0x0000);
+	vExtra.assign(nStride, 0x00);
+	vFetched.assign(nStride, 0x00);
+	vResult.assign(nStride, 0x00);
+	vTarget.assign(nStride, 0);
+	vPass.reserve(nStride);
+}
+
+uint8_t LockstepCPU::read(size_t nLane, uint16_t addr)
+{
+	if (addr <= 0x1FFF)
+		return vRAM[(addr & 0x07FF) * nStride + nLane];
+
+	if (addr >= 0x8000)
+		return rom(addr);
+
+	if (addr >= 0x4016 && addr <= 0x4017)
+	{
+		// Read out the MSB of the controller status word
+		uint8_t& state = controller_state[addr & 0x0001][nLane];
+		uint8_t data = (state & 0x80) > 0;
+		state <<= 1;
+		return data;
+	}
+
+	return pIO ? pIO->cpuRead(nLane, addr) : 0x00;
+}
+
+void LockstepCPU::write(size_t nLane, uint16_t addr, uint8_t data)
+{
+	if (addr <= 0x1FFF)
+		vRAM[(addr & 0x07FF) * nStride + nLane] = data;
+	else if (addr >= 0x8000)
+		return; // ROM, and no mapper registers
+	else if (addr == 0x4016)
+		controller_state[0][nLane] = controller[0][nLane]; // "Lock in" controller state at this time
+	else if (pIO)
+		pIO->cpuWrite(nLane, addr, data);
+}
+
+void LockstepCPU::push(size_t nLane, uint8_t data)
+{
+	write(nLane, 0x0100 + stkp[nLane], data);
+	stkp[nLane]--;
+}
+
+uint8_t LockstepCPU::pull(size_t nLane)
+{
+	stkp[nLane]++;
+	return read(nLane, 0x0100 + stkp[nLane]);
+}
+
+void LockstepCPU::reset()
+{
+	for (size_t l = 0; l < nLanes; l++)
+	{
+		accumulator[l] = 0;
+		x[l] = 0;
+		y[l] = 0;
+		stkp[l] = 0xFD;
+		status[l] = 0x00 | U;
+		pc[l] = (uint16_t)read(l, 0xFFFC) | ((uint16_t)read(l, 0xFFFD) << 8);
+		cycles[l] += 8;
+	}
+}
+
+void LockstepCPU::irq(size_t nLane)
+{
+	if (status[nLane] & I)
+		return;
+
+	push(nLane, (pc[nLane] >> 8) & 0x00FF);
+	push(nLane, pc[nLane] & 0x00FF);
+	status[nLane] = (status[nLane] & ~B) | U;
+	push(nLane, status[nLane]);
+	status[nLane] |= I;
+	pc[nLane] = (uint16_t)read(nLane, 0xFFFE) | ((uint16_t)read(nLane, 0xFFFF) << 8);
+	cycles[nLane] += 7;
+}
+
+void LockstepCPU::nmi(size_t nLane)
+{
+	push(nLane, (pc[nLane] >> 8) & 0x00FF);
+	push(nLane, pc[nLane] & 0x00FF);
+	status[nLane] = (status[nLane] & ~B) | U;
+	push(nLane, status[nLane]);
+	status[nLane] |= I;
+	pc[nLane] = (uint16_t)read(nLane, 0xFFFA) | ((uint16_t)read(nLane, 0xFFFB) << 8);
+	cycles[nLane] += 8;
+}
+
+void LockstepCPU::step()
+{
+	std::fill(vEligible.begin(), vEligible.begin() + nLanes, 0xFF);
+	bReuse = false;
+
+	while (pass())
+	{
+		for (size_t i = 0; i < nStride; i++)
+			vEligible[i] &= ~vMask[i];
+		bReuse = false;
+	}
+}
+
+void LockstepCPU::run(uint32_t nCycles)
+{
+	for (size_t l = 0; l < nLanes; l++)
+	{
+		vTarget[l] = cycles[l] + nCycles;
+		vEligible[l] = nCycles > 0 ? 0xFF : 0x00;
+	}
+
+	bReuse = false;
+	int64_t nSlack = 0; // Cycles the lanes in the pass are all at least this far from their targets
+
+	bool bReused = bReuse;
+	while (pass())
+	{
+		// Only check lanes against their targets when one may be near it
+		nSlack -= nPassCycles;
+		if (bReused && nSlack > 0)
+		{
+			bReused = bReuse;
+			continue;
+		}
+
+		bool bFinished = false;
+		nSlack = INT64_MAX;
+		for (uint32_t l : vPass)
+		{
+			int32_t nLeft = (int32_t)(vTarget[l] - cycles[l]);
+			if (nLeft <= 0)
+			{
+				vEligible[l] = 0x00;
+				bFinished = true;
+			}
+			else
+				nSlack = std::min<int64_t>(nSlack, nLeft);
+		}
+
+		if (bFinished)
+			bReuse = false;
+		bReused = bReuse;
+	}
+}
+
+// Gather the lanes which are to execute together, those eligible at the
+// lowest PC, and execute one instruction for them. False if none are left.
+bool LockstepCPU::pass()
+{
+	uint16_t nPC = nReusePC;
+
+	// Code in ROM is the same for every lane
+	uint8_t opcode = nPC >= 0x8000 ? rom(nPC) : 0x00;
+
+	if (!bReuse)
+	{
+		uint32_t nLowest = 0x10000;
+		for (size_t i = 0; i < nStride; i++)
+			nLowest = std::min(nLowest, vEligible[i] ? (uint32_t)pc[i] : 0x10000u);
+
+		if (nLowest == 0x10000)
+			return false;
+
+		nPC = (uint16_t)nLowest;
+		opcode = nPC >= 0x8000 ? rom(nPC) : 0x00;
+		for (size_t i = 0; i < nStride; i++)
+			vMask[i] = vEligible[i] & (pc[i] == nPC ? 0xFF : 0x00);
+
+		if (nPC < 0x8000)
+		{
+			// Fetching from a device may have side effects, so only one
+			// lane can be let at it at a time. Code in RAM may differ
+			// between lanes, so each opcode there has its own pass.
+			size_t nFirst = 0;
+			while (!vMask[nFirst])
+				nFirst++;
+
+			opcode = read(nFirst, nPC);
+			for (size_t i = nFirst + 1; i < nStride; i++)
+			{
+				if (vMask[i] && (nPC >= 0x2000 || read(i, nPC) != opcode))
+					vMask[i] = 0x00;
+			}
+		}
+
+		bAlone = true;
+		vPass.resize(nStride);
+		size_t nPass = 0;
+		for (size_t i = 0; i < nStride; i++)
+		{
+			vMask16[i] = vMask[i] ? 0xFFFF : 0x0000;
+			vMask32[i] = vMask[i] ? 0xFFFFFFFF : 0x00000000;
+			bAlone &= !(vEligible[i] & ~vMask[i]);
+			vPass[nPass] = (uint32_t)i;
+			nPass += vMask[i] & 1;
+		}
+		vPass.resize(nPass);
+	}
+
+	bool bTogether = execute(nPC, opcode);
+
+	// If every lane is still at the same place, and still to be run, the
+	// next pass is of the same lanes, at their new PC
+	nReusePC = pc[vPass[0]];
+	bReuse = bTogether && bAlone && nReusePC >= 0x8000;
+
+	nPasses++;
+	nLaneInstructions += vPass.size();
+	return true;
+}
+
+// The operand of every lane in the pass. Where they all agree on an address
+// in RAM this is simply that row of RAM.
+const uint8_t* LockstepCPU::fetch(uint16_t nAddr, bool bUniform)
+{
+	if (bUniform && nAddr <= 0x1FFF)
+		return &vRAM[(nAddr & 0x07FF) * nStride];
+
+	if (bUniform && nAddr >= 0x8000)
+	{
+		std::memset(vFetched.data(), rom(nAddr), nStride);
+		return vFetched.data();
+	}
+
+	for (uint32_t l : vPass)
+		vFetched[l] = read(l, bUniform ? nAddr : vAddr[l]);
+
+	return vFetched.data();
+}
+
+void LockstepCPU::store(const uint8_t* pData, uint16_t nAddr, bool bUniform)
+{
+	if (bUniform && nAddr <= 0x1FFF)
+	{
+		uint8_t* pRow = &vRAM[(nAddr & 0x07FF) * nStride];
+		for (size_t i = 0; i < nStride; i += 16)
+			SetReg(pRow + i, V16::load(&vMask[i]), V16::load(pData + i));
+		return;
+	}
+
+	for (uint32_t l : vPass)
+		write(l, bUniform ? nAddr : vAddr[l], pData[l]);
+}
+
+bool LockstepCPU::execute(uint16_t nPC, uint8_t opcode)
+{
+	const INSTRUCTION& ins = lookup[opcode];
+	uint16_t nNext = nPC + 1;
+
+	// Addressing Modes
+	// Code in ROM is the same for every lane, and for modes which do not
+	// depend on registers, so is the address. Otherwise each lane works
+	// out its own, though they may still all come to the same one.
+	uint16_t nAddr = 0x0000;
+	bool bUniform = true;
+	bool bPageCross = false;
+	const bool bROM = nPC >= 0x8000 && nPC <= 0xFFFD;
+
+	auto operand = [&](size_t l, uint16_t nOffset) { return bROM ? rom(nNext + nOffset) : read(l, nNext + nOffset); };
+
+	switch (ins.addrmode)
+	{
+	case IMP:
+		break;
+
+	case IMM:
+		nAddr = nNext++;
+		break;
+
+	case ZP0:
+	case REL:
+	case ABS:
+		if (bROM)
+		{
+			nAddr = rom(nNext);
+			if (ins.addrmode == ABS)
+				nAddr |= rom(nNext + 1) << 8;
+			else if (ins.addrmode == REL && (nAddr & 0x80))
+				nAddr |= 0xFF00;
+		}
+		else
+		{
+			for (uint32_t l : vPass)
+			{
+				vAddr[l] = operand(l, 0);
+				if (ins.addrmode == ABS)
+					vAddr[l] |= operand(l, 1) << 8;
+				else if (ins.addrmode == REL && (vAddr[l] & 0x80))
+					vAddr[l] |= 0xFF00;
+			}
+			bUniform = false;
+		}
+		nNext += ins.addrmode == ABS ? 2 : 1;
+		break;
+
+	default:
+		for (uint32_t l : vPass)
+		{
+			uint16_t lo = operand(l, 0);
+			uint16_t hi = 0x00;
+
+			switch (ins.addrmode)
+			{
+			case ZPX: vAddr[l] = (lo + x[l]) & 0x00FF; break;
+			case ZPY: vAddr[l] = (lo + y[l]) & 0x00FF; break;
+
+			case ABX:
+			case ABY:
+				hi = operand(l, 1);
+				vAddr[l] = ((hi << 8) | lo) + (ins.addrmode == ABX ? x[l] : y[l]);
+				vExtra[l] = (vAddr[l] & 0xFF00) != (hi << 8);
+				break;
+
+			case IND:
+			{
+				uint16_t ptr = ((uint16_t)operand(l, 1) << 8) | lo;
+				if (lo == 0x00FF)
+				{
+					// The page boundary bug is read, but not used
+					read(l, ptr & 0xFF00);
+					read(l, ptr + 0);
+				}
+				hi = read(l, ptr + 1);
+				vAddr[l] = (hi << 8) | read(l, ptr + 0);
+				break;
+			}
+
+			case IZX:
+				vAddr[l] = read(l, (uint16_t)(lo + x[l]) & 0x00FF);
+				vAddr[l] |= read(l, (uint16_t)(lo + x[l] + 1) & 0x00FF) << 8;
+				break;
+
+			case IZY:
+				hi = read(l, (lo + 1) & 0x00FF);
+				vAddr[l] = ((hi << 8) | read(l, lo & 0x00FF)) + y[l];
+				vExtra[l] = (vAddr[l] & 0xFF00) != (hi << 8);
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		nNext += (ins.addrmode == ABX || ins.addrmode == ABY || ins.addrmode == IND) ? 2 : 1;
+		bPageCross = ins.addrmode == ABX || ins.addrmode == ABY || ins.addrmode == IZY;
+
+		// Lanes walking the same array with the same index still agree
+		nAddr = vAddr[vPass[0]];
+		for (uint32_t l : vPass)
+			bUniform &= vAddr[l] == nAddr;
+		break;
+	}
+
+	for (size_t i = 0; i < nStride; i++)
+		pc[i] = (pc[i] & ~vMask16[i]) | (nNext & vMask16[i]);
+
+	bool bTogether = true;
+	nPassCycles = ins.cycles + (bPageCross ? 1 : 0);
+
+	// Operations
+	// Registers and flags are worked on a vector of lanes at a time, those
+	// not in this pass being left as they are. Control flow and the stack
+	// are per lane, as lanes are liable to go their separate ways.
+	uint8_t* pA = accumulator.data();
+	uint8_t* pX = x.data();
+	uint8_t* pY = y.data();
+	uint8_t* pS = stkp.data();
+	uint8_t* pP = status.data();
+
+	auto vectors = [&](auto fn)
+	{
+		for (size_t i = 0; i < nStride; i += 16)
+		{
+			V16 m = V16::load(&vMask[i]);
+			if (any(m))
+				fn(i, m);
+		}
+	};
+
+	// Only these take the extra cycle when their address crosses a page
+	bool bExtraCycle = false;
+
+	switch (ins.operate)
+	{
+	case LDA:
+	case LDX:
+	case LDY:
+	{
+		uint8_t* pReg = ins.operate == LDA ? pA : ins.operate == LDX ? pX : pY;
+		const uint8_t* pF = fetch(nAddr, bUniform);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 r = V16::load(pF + i);
+			SetReg(pReg + i, m, r);
+			SetFlags(pP + i, m, Z | N, FlagsNZ(r));
+		});
+		bExtraCycle = true;
+		break;
+	}
+
+	case STA:
+	case STX:
+	case STY:
+		store(ins.operate == STA ? pA : ins.operate == STX ? pX : pY, nAddr, bUniform);
+		break;
+
+	case AND:
+	case ORA:
+	case EOR:
+	{
+		const uint8_t* pF = fetch(nAddr, bUniform);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 a = V16::load(pA + i), f = V16::load(pF + i);
+			V16 r = ins.operate == AND ? (a & f) : ins.operate == ORA ? (a | f) : (a ^ f);
+			SetReg(pA + i, m, r);
+			SetFlags(pP + i, m, Z | N, FlagsNZ(r));
+		});
+		bExtraCycle = true;
+		break;
+	}
+
+	case ADC:
+	case SBC:
+	{
+		// Subtraction is addition of the inverted operand. The carry out
+		// is either from adding the operand, or from adding the carry in
+		// to 0xFF.
+		const uint8_t* pF = ins.addrmode == IMP ? pA : fetch(nAddr, bUniform);
+		const V16 inv = V16::set(ins.operate == SBC ? 0xFF : 0x00);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 a = V16::load(pA + i), f = V16::load(pF + i) ^ inv;
+			V16 c = V16::load(pP + i) & V16::set(C);
+			V16 t = a + f;
+			V16 r = t + c;
+			V16 carry = andnot(eq(max(t, a), t), V16::set(C)) | (eq(t, V16::set(0xFF)) & c);
+			V16 overflow = shr1(andnot(a ^ f, a ^ r) & V16::set(0x80));
+			SetReg(pA + i, m, r);
+			SetFlags(pP + i, m, C | Z | V | N, carry | overflow | FlagsNZ(r));
+		});
+		bExtraCycle = true;
+		break;
+	}
+
+	case CMP:
+	case CPX:
+	case CPY:
+	{
+		const uint8_t* pReg = ins.operate == CMP ? pA : ins.operate == CPX ? pX : pY;
+		const uint8_t* pF = fetch(nAddr, bUniform);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 r = V16::load(pReg + i), f = V16::load(pF + i);
+			V16 flags = (eq(max(r, f), r) & V16::set(C)) | (eq(r, f) & V16::set(Z)) | ((r - f) & V16::set(N));
+			SetFlags(pP + i, m, C | Z | N, flags);
+		});
+		bExtraCycle = ins.operate == CMP;
+		break;
+	}
+
+	case INC:
+	case DEC:
+	{
+		const uint8_t* pF = fetch(nAddr, bUniform);
+		const V16 d = V16::set(ins.operate == INC ? 0x01 : 0xFF);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 r = V16::load(pF + i) + d;
+			r.store(&vResult[i]);
+			SetFlags(pP + i, m, Z | N, FlagsNZ(r));
+		});
+		store(vResult.data(), nAddr, bUniform);
+		break;
+	}
+
+	case INX:
+	case INY:
+	case DEX:
+	case DEY:
+	{
+		uint8_t* pReg = (ins.operate == INX || ins.operate == DEX) ? pX : pY;
+		const V16 d = V16::set((ins.operate == INX || ins.operate == INY) ? 0x01 : 0xFF);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 r = V16::load(pReg + i) + d;
+			SetReg(pReg + i, m, r);
+			SetFlags(pP + i, m, Z | N, FlagsNZ(r));
+		});
+		break;
+	}
+
+	case TAX:
+	case TAY:
+	case TSX:
+	case TXA:
+	case TYA:
+	case TXS:
+	{
+		const uint8_t* pSrc = (ins.operate == TAX || ins.operate == TAY) ? pA : ins.operate == TSX ? pS : (ins.operate == TYA ? pY : pX);
+		uint8_t* pDst = (ins.operate == TAX || ins.operate == TSX) ? pX : ins.operate == TAY ? pY : ins.operate == TXS ? pS : pA;
+		vectors([&](size_t i, V16 m)
+		{
+			V16 r = V16::load(pSrc + i);
+			SetReg(pDst + i, m, r);
+			if (ins.operate != TXS)
+				SetFlags(pP + i, m, Z | N, FlagsNZ(r));
+		});
+		break;
+	}
+
+	case ASL:
+	case LSR:
+	case ROL:
+	case ROR:
+	{
+		const uint8_t* pF = ins.addrmode == IMP ? pA : fetch(nAddr, bUniform);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 f = V16::load(pF + i);
+			V16 cin = V16::load(pP + i) & V16::set(C);
+			V16 hibit = eq(f & V16::set(0x80), V16::set(0x80)) & V16::set(C);
+			V16 lobit = f & V16::set(C);
+			V16 r, carry;
+			switch (ins.operate)
+			{
+			case ASL: r = f + f; carry = hibit; break;
+			case LSR: r = shr1(f); carry = lobit; break;
+			case ROL: r = (f + f) | cin; carry = hibit; break;
+			default:  r = shr1(f) | (eq(cin, V16::set(C)) & V16::set(0x80)); carry = lobit; break;
+			}
+			if (ins.addrmode == IMP)
+				SetReg(pA + i, m, r);
+			else
+				r.store(&vResult[i]);
+			SetFlags(pP + i, m, C | Z | N, carry | FlagsNZ(r));
+		});
+		if (ins.addrmode != IMP)
+			store(vResult.data(), nAddr, bUniform);
+		break;
+	}
+
+	case BIT:
+	{
+		const uint8_t* pF = fetch(nAddr, bUniform);
+		vectors([&](size_t i, V16 m)
+		{
+			V16 f = V16::load(pF + i);
+			V16 flags = (eq(V16::load(pA + i) & f, V16::set(0x00)) & V16::set(Z)) | (f & V16::set(N | V));
+			SetFlags(pP + i, m, Z | N | V, flags);
+		});
+		break;
+	}
+
+	case CLC: case CLD: case CLI: case CLV:
+	case SEC: case SED: case SEI:
+	{
+		uint8_t nFlag = (ins.operate == CLC || ins.operate == SEC) ? C
+			: (ins.operate == CLD || ins.operate == SED) ? D
+			: (ins.operate == CLI || ins.operate == SEI) ? I : V;
+		V16 flags = V16::set((ins.operate == SEC || ins.operate == SED || ins.operate == SEI) ? nFlag : 0x00);
+		vectors([&](size_t i, V16 m) { SetFlags(pP + i, m, nFlag, flags); });
+		break;
+	}
+
+	case BCC: case BCS: case BEQ: case BMI:
+	case BNE: case BPL: case BVC: case BVS:
+	{
+		uint8_t nFlag = (ins.operate == BCC || ins.operate == BCS) ? C
+			: (ins.operate == BEQ || ins.operate == BNE) ? Z
+			: (ins.operate == BMI || ins.operate == BPL) ? N : V;
+		uint8_t nWhen = (ins.operate == BCS || ins.operate == BEQ || ins.operate == BMI || ins.operate == BVS) ? nFlag : 0x00;
+		nPassCycles += 2;
+
+		if (bUniform)
+		{
+			// Every lane goes to one of the same two places
+			uint16_t nTarget = nNext + nAddr;
+			uint8_t nTaken = ((nTarget & 0xFF00) != (nNext & 0xFF00)) ? 2 : 1;
+			vectors([&](size_t i, V16 m)
+			{
+				(m & eq(V16::load(pP + i) & V16::set(nFlag), V16::set(nWhen))).store(&vResult[i]);
+			});
+
+			uint8_t nAny = 0x00, nAll = 0xFF;
+			for (size_t i = 0; i < nStride; i++)
+			{
+				uint8_t bTaken = vResult[i] & vMask[i];
+				uint16_t m = bTaken ? 0xFFFF : 0x0000;
+				pc[i] = (pc[i] & ~m) | (nTarget & m);
+				cycles[i] += nTaken & m;
+				nAny |= bTaken;
+				nAll &= bTaken | (uint8_t)~vMask[i];
+			}
+			bTogether = !nAny || nAll;
+		}
+		else
+		{
+			for (uint32_t l : vPass)
+			{
+				if ((status[l] & nFlag) == nWhen)
+				{
+					uint16_t nTarget = pc[l] + vAddr[l];
+					cycles[l] += ((nTarget & 0xFF00) != (pc[l] & 0xFF00)) ? 2 : 1;
+					pc[l] = nTarget;
+				}
+			}
+			bTogether = false;
+		}
+		break;
+	}
+
+	case JMP:
+		for (uint32_t l : vPass)
+			pc[l] = bUniform ? nAddr : vAddr[l];
+		bTogether = bUniform;
+		break;
+
+	case JSR:
+		for (uint32_t l : vPass)
+		{
+			uint16_t nReturn = pc[l] - 1;
+			push(l, (nReturn >> 8) & 0x00FF);
+			push(l, nReturn & 0x00FF);
+			pc[l] = bUniform ? nAddr : vAddr[l];
+		}
+		bTogether = bUniform;
+		break;
+
+	case RTS:
+		for (uint32_t l : vPass)
+		{
+			uint16_t lo = pull(l);
+			uint16_t hi = pull(l);
+			pc[l] = ((hi << 8) | lo) + 1;
+			bTogether &= pc[l] == pc[vPass[0]];
+		}
+		break;
+
+	case RTI:
+		for (uint32_t l : vPass)
+		{
+			status[l] = pull(l) & ~B & ~U;
+			uint16_t lo = pull(l);
+			uint16_t hi = pull(l);
+			pc[l] = (hi << 8) | lo;
+			bTogether &= pc[l] == pc[vPass[0]];
+		}
+		break;
+
+	case BRK:
+		for (uint32_t l : vPass)
+		{
+			uint16_t nReturn = pc[l] + 1;
+			status[l] |= I;
+			push(l, (nReturn >> 8) & 0x00FF);
+			push(l, nReturn & 0x00FF);
+			push(l, status[l] | B);
+			status[l] &= ~B;
+			pc[l] = (uint16_t)read(l, 0xFFFE) | ((uint16_t)read(l, 0xFFFF) << 8);
+		}
+		break;
+
+	case PHA:
+		for (uint32_t l : vPass)
+			push(l, accumulator[l]);
+		break;
+
+	case PHP:
+		for (uint32_t l : vPass)
+		{
+			push(l, status[l] | B | U);
+			status[l] &= ~(B | U);
+		}
+		break;
+
+	case PLA:
+		for (uint32_t l : vPass)
+		{
+			accumulator[l] = pull(l);
+			status[l] = (status[l] & ~(Z | N)) | (accumulator[l] == 0x00 ? Z : 0x00) | (accumulator[l] & N);
+		}
+		break;
+
+	case PLP:
+		for (uint32_t l : vPass)
+			status[l] = pull(l) | U;
+		break;
+
+	case NOP:
+	case XXX:
+		break;
+	}
+
+	if (bPageCross && bExtraCycle)
+	{
+		for (uint32_t l : vPass)
+			cycles[l] += ins.cycles + vExtra[l];
+	}
+	else
+	{
+		for (size_t i = 0; i < nStride; i++)
+			cycles[i] += ins.cycles & vMask32[i];
+	}
+
+	return bTogether;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "RomCache.h"
+
+// Lockstep CPUs (experimental)
+// Many copies of one program, e.g. the same game given different inputs, run
+// side by side as lanes of a single wide 6502. The register file and RAM are
+// held as structures of arrays, one entry per lane, RAM interleaved so that
+// the same address in every lane is one contiguous row. Each pass executes one
+// instruction for every lane whose PC is at the same place, with the operation
+// done 16 lanes at a time in vector registers and RAM at an address the lanes
+// agree on read and written as a whole row. Where lanes part ways, each group
+// is run in a pass of its own, lowest PC first, which brings lanes that branch
+// around a block or go round a loop fewer times back together afterwards.
+// It only pays while most lanes keep together. Lanes that have gone their
+// own ways cost more than running them one at a time on olc6502.
+//
+// Only the CPU, RAM, PRG ROM and controller ports are emulated, and only for
+// cartridges with no mapper (NROM). Anything else a lane reads or writes goes
+// to the IO given, per lane, and interrupts are raised by the caller. There is
+// no OAM DMA stall. Each lane executes exactly as olc6502 would.
+class LockstepCPU
+{
+public:
+	// Where lanes' accesses outside RAM, ROM and the controllers go
+	struct IO
+	{
+		virtual ~IO() = default;
+		virtual uint8_t cpuRead(size_t /*nLane*/, uint16_t /*addr*/) { return 0x00; }
+		virtual void cpuWrite(size_t /*nLane*/, uint16_t /*addr*/, uint8_t /*data*/) {}
+	};
+
+	LockstepCPU(std::shared_ptr<const RomImage> image, size_t nLanes, IO* pIO = nullptr);
+
+	// False if the ROM is not one this can run
+	bool Valid() const { return pImage != nullptr; }
+	size_t Lanes() const { return nLanes; }
+
+	void reset(); // Every lane
+	void irq(size_t nLane);
+	void nmi(size_t nLane);
+
+	// Execute one instruction in every lane
+	void step();
+
+	// Execute instructions in every lane until it has run at least nCycles
+	// more cycles, i.e. stopping on the same instruction it would if run alone
+	void run(uint32_t nCycles);
+
+	uint8_t& ram(size_t nLane, uint16_t addr) { return vRAM[(addr & 0x07FF) * nStride + nLane]; }
+
+	// Register file, one entry per lane. Each is padded out to a whole
+	// number of vectors, and entries past Lanes() mean nothing.
+	std::vector<uint8_t> accumulator;
+	std::vector<uint8_t> x;
+	std::vector<uint8_t> y;
+	std::vector<uint8_t> stkp;
+	std::vector<uint16_t> pc;
+	std::vector<uint8_t> status;
+	std::vector<uint32_t> cycles; // Elapsed, as olc6502::clock_count
+
+	// Controllers, as Bus::controller, one entry per lane for each port
+	std::vector<uint8_t> controller[2];
+
+	// How well the lanes keep together, the average lanes per pass
+	uint64_t nLaneInstructions = 0;
+	uint64_t nPasses = 0;
+
+private:
+	std::shared_ptr<const RomImage> pImage;
+	IO* pIO = nullptr;
+
+	size_t nLanes = 0;
+	size_t nStride = 0; // Lanes, rounded up to whole vectors
+
+	std::vector<uint8_t> vRAM; // 2KB per lane, interleaved
+	std::vector<uint8_t> controller_state[2];
+
+	// Per pass, one entry per lane
+	std::vector<uint8_t> vEligible; // Lanes yet to execute as far as asked
+	std::vector<uint8_t> vMask; // 0xFF for lanes taking part in this pass
+	std::vector<uint16_t> vMask16; // The same, widened for the PC
+	std::vector<uint32_t> vMask32; // ...and for the cycle count
+	std::vector<uint32_t> vPass; // The lanes taking part in this pass
+	std::vector<uint16_t> vAddr; // Operand address
+	std::vector<uint8_t> vExtra; // Addressing mode crossed a page
+	std::vector<uint8_t> vFetched; // Operand
+	std::vector<uint8_t> vResult;
+	std::vector<uint32_t> vTarget; // run() stops each lane on reaching this
+
+	// While every eligible lane stays together, each pass is of the same
+	// lanes as the last, so there is no need to look for them again
+	bool bReuse = false;
+	uint16_t nReusePC = 0x0000;
+	bool bAlone = false; // No eligible lanes are outside this pass
+	uint32_t nPassCycles = 0; // The most cycles a lane in the pass can have taken
+
+	uint8_t read(size_t nLane, uint16_t addr);
+	void write(size_t nLane, uint16_t addr, uint8_t data);
+	uint8_t rom(uint16_t addr) const { return pImage->pPRGMemory[(addr & 0x7FFF) % pImage->nPRGSize]; }
+
+	bool pass();
+	bool execute(uint16_t nPC, uint8_t opcode); // True if the lanes are still together
+	const uint8_t* fetch(uint16_t nAddr, bool bUniform);
+	void store(const uint8_t* pData, uint16_t nAddr, bool bUniform);
+	void push(size_t nLane, uint8_t data);
+	uint8_t pull(size_t nLane);
+
+	enum OPERATION : uint8_t
+	{
+		ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+		CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+		JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+		RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+		XXX,
+	};
+
+	enum ADDRMODE : uint8_t
+	{
+		IMP, IMM, ZP0, ZPX, ZPY, REL, ABS, ABX, ABY, IND, IZX, IZY,
+	};
+
+	struct INSTRUCTION
+	{
+		OPERATION operate;
+		ADDRMODE addrmode;
+		uint8_t cycles;
+	};
+
+	static const INSTRUCTION lookup[256]; // From OpcodeTable.h, as olc6502's is
+};
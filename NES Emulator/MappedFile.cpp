@@ -0,0 +1,120 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::string& sFileName)
+{
+	std::shared_ptr<MappedFile> pFile(new MappedFile());
+	if (!pFile->Map(sFileName) && !pFile->Read(sFileName))
+		return nullptr;
+
+	return pFile;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Map(const std::string& sFileName)
+{
+	HANDLE hFile = CreateFileA(sFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER nFileSize;
+	HANDLE hMapping = nullptr;
+	if (GetFileSizeEx(hFile, &nFileSize) && nFileSize.QuadPart > 0)
+		hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	// The mapping keeps the file open by itself
+	CloseHandle(hFile);
+	if (hMapping == nullptr)
+		return false;
+
+	void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (pView == nullptr)
+	{
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	pMapping = hMapping;
+	pData = (const uint8_t*)pView;
+	nSize = (size_t)nFileSize.QuadPart;
+	return true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (pMapping != nullptr)
+	{
+		UnmapViewOfFile(pData);
+		CloseHandle((HANDLE)pMapping);
+	}
+}
+
+#else
+
+bool MappedFile::Map(const std::string& sFileName)
+{
+	int fd = open(sFileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	void* pView = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		pView = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	// A file being written as it is mapped may be truncated or changed
+	// under the mapping, so it is better read as it stands
+	struct stat stAfter;
+	if (pView != MAP_FAILED && (fstat(fd, &stAfter) != 0
+		|| stAfter.st_size != st.st_size
+		|| stAfter.st_mtim.tv_sec != st.st_mtim.tv_sec
+		|| stAfter.st_mtim.tv_nsec != st.st_mtim.tv_nsec))
+	{
+		munmap(pView, (size_t)st.st_size);
+		pView = MAP_FAILED;
+	}
+
+	// The mapping keeps the file open by itself
+	close(fd);
+	if (pView == MAP_FAILED)
+		return false;
+
+	pMapping = pView;
+	pData = (const uint8_t*)pView;
+	nSize = (size_t)st.st_size;
+	return true;
+}
+
+MappedFile::~MappedFile()
+{
+	if (pMapping != nullptr)
+		munmap(pMapping, nSize);
+}
+
+#endif
+
+bool MappedFile::Read(const std::string& sFileName)
+{
+	std::ifstream ifs(sFileName, std::ifstream::binary);
+	if (!ifs.is_open())
+		return false;
+
+	vCopy.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+	pData = vCopy.data();
+	nSize = vCopy.size();
+	return true;
+}
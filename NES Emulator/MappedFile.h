@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A whole file, mapped read-only into memory. The operating system pages it
+// in as it is touched and shares those pages with every other mapping of the
+// same file, in this process or any other, so a ROM opened by hundreds of
+// consoles exists in memory once. Each Open() maps the file as it is then;
+// sharing one mapping between loads is left to RomCache, which knows when
+// the contents are the same. Where a file can not be mapped it is simply
+// read into memory instead.
+//
+// The mapping reads the file itself, not a copy, so the file must not be
+// rewritten in place while mapped: its contents would change underneath
+// anything using them, and reading past a truncated end faults. Replacing
+// the file, by writing a new one and renaming it over the old, is safe, as
+// the mapping keeps the old file. A file seen changing while it is mapped
+// is read into memory instead.
+class MappedFile
+{
+public:
+	static std::shared_ptr<const MappedFile> Open(const std::string& sFileName);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* Data() const { return pData; }
+	size_t Size() const { return nSize; }
+
+private:
+	MappedFile() = default;
+	bool Map(const std::string& sFileName);
+	bool Read(const std::string& sFileName);
+
+	const uint8_t* pData = nullptr;
+	size_t nSize = 0;
+
+	void* pMapping = nullptr; // Platform handle of the mapping, if mapped
+	std::vector<uint8_t> vCopy; // The file's contents, if it could not be mapped
+};
@@ -28,12 +28,79 @@ bool Mapper::irqState()
 	return false;
 }
 
-void Mapper::irqClear()
+bool Mapper::countsScanlines() const
 {
-
+	return false;
 }
 
 void Mapper::scanline()
 {
 
+}
+
+void Mapper::connectMemory(uint8_t* prg, size_t nPRGSize, uint8_t* chr, size_t nCHRSize)
+{
+	pPRGMemory = prg;
+	pCHRMemory = chr;
+	nPRGMemory = nPRGSize;
+	nCHRMemory = nCHRSize;
+	bCHRWritable = nCHRBanks == 0;
+
+	// Now there is memory to point at, set up the initial banks
+	reset();
+}
+
+void Mapper::setPRGBank(uint8_t nWindow, uint32_t nOffset)
+{
+	if (pPRGMemory == nullptr || nPRGMemory == 0)
+		return;
+
+	uint8_t* pBank = pPRGMemory + (nOffset % nPRGMemory);
+	if (pPRGBank[nWindow] != pBank)
+	{
+		pPRGBank[nWindow] = pBank;
+		bPRGMapChanged = true;
+	}
+}
+
+void Mapper::setCHRBank(uint8_t nWindow, uint32_t nOffset)
+{
+	if (pCHRMemory == nullptr || nCHRMemory == 0)
+		return;
+
+	pCHRBank[nWindow] = pCHRMemory + (nOffset % nCHRMemory);
+}
+
+void Mapper::saveState(StateWriter& state) const
+{
+	// As offsets into the cartridge's memory
+	for (uint8_t i = 0; i < 4; i++)
+		state.Write((uint32_t)(pPRGBank[i] ? pPRGBank[i] - pPRGMemory : 0));
+
+	for (uint8_t i = 0; i < 8; i++)
+		state.Write((uint32_t)(pCHRBank[i] ? pCHRBank[i] - pCHRMemory : 0));
+}
+
+void Mapper::loadState(StateReader& state)
+{
+	uint32_t nOffset = 0;
+
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		state.Read(nOffset);
+		setPRGBank(i, nOffset);
+	}
+
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		state.Read(nOffset);
+		setCHRBank(i, nOffset);
+	}
+}
+
+bool Mapper::prgMapChanged()
+{
+	bool bChanged = bPRGMapChanged;
+	bPRGMapChanged = false;
+	return bChanged;
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
+
+#include "SaveState.h"
+#include "Scheduler.h"
 
 enum MIRROR
 {
@@ -9,6 +13,7 @@ enum MIRROR
 	VERTICAL,
 	ONESCREEN_LO,
 	ONESCREEN_HI,
+	FOURSCREEN,		// Cartridge has VRAM for all four nametables
 };
 
 class Mapper
@@ -17,25 +22,67 @@ public:
 	Mapper(uint8_t prgBanks, uint8_t chrBanks);
 	~Mapper();
 
-	virtual bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr, uint8_t &data) = 0;
-	virtual bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr, uint8_t data = 0) = 0;
-	virtual bool ppuMapRead(uint16_t addr, uint32_t &mapped_addr) = 0;
-	virtual bool ppuMapWrite(uint16_t addr, uint32_t& mapped_addr) = 0;
+	// Give the mapper the cartridge memory it switches banks of
+	void connectMemory(uint8_t* prg, size_t nPRGSize, uint8_t* chr, size_t nCHRSize);
+
+	// Writes to mapper registers, anywhere in 0x8000 - 0xFFFF
+	virtual void cpuMapWrite(uint16_t addr, uint8_t data) = 0;
 
 	virtual void reset() = 0;
 	
 	virtual MIRROR mirror(); // Get Mirror Mode if Mapper is in control
 	
 	// IRQ Interface
+	// A mapper raises its IRQ through the scheduler of the bus it is
+	// plugged into, and holds it until the program acknowledges it; the bus
+	// asks irqState() after each write to the cartridge to see if it has let go
+	void ConnectScheduler(Scheduler* scheduler) { pScheduler = scheduler; }
 	virtual bool irqState();
-	virtual void irqClear();
 
 	// Scanline counting
+	// A mapper which counts scanlines says so, and the bus then clocks
+	// scanline() on each rising edge of PPU address line A12
+	virtual bool countsScanlines() const;
 	virtual void scanline();
 
+	// Where the bank windows point, followed by whatever registers and
+	// memory a mapper has of its own, which it adds to these
+	virtual void saveState(StateWriter& state) const;
+	virtual void loadState(StateReader& state);
+
+	// Returns true, once, after PRG banks have been switched
+	bool prgMapChanged();
+
+	// Bank Windows
+	// Where each window of address space currently points. The mapper keeps
+	// these up to date as its registers are written, so that reads and
+	// writes go straight to memory rather than asking the mapper each time.
+	uint8_t* pPRGRAM = nullptr;				// 8KB at CPU 0x6000 - 0x7FFF, nullptr if there is none
+	uint8_t* pPRGBank[4] = { nullptr };		// 8KB each, CPU 0x8000 - 0xFFFF
+	uint8_t* pCHRBank[8] = { nullptr };		// 1KB each, PPU 0x0000 - 0x1FFF
+	bool bCHRWritable = false;				// Pattern memory is RAM rather than ROM
+
 protected:
 	// Stored locally as many mappers need this information.
 	uint8_t nPRGBanks = 0;
 	uint8_t nCHRBanks = 0;
+
+	// Set whenever PRG banks are switched, so that anything holding
+	// on to where the CPU's address space points can update
+	bool bPRGMapChanged = false;
+
+	Scheduler* pScheduler = nullptr;
+
+	// Point an 8KB PRG window or a 1KB CHR window at an offset into
+	// memory. Offsets wrap around the memory actually present, as the
+	// upper bank select bits would simply not be connected on the board.
+	void setPRGBank(uint8_t nWindow, uint32_t nOffset);
+	void setCHRBank(uint8_t nWindow, uint32_t nOffset);
+
+private:
+	uint8_t* pPRGMemory = nullptr;
+	uint8_t* pCHRMemory = nullptr;
+	size_t nPRGMemory = 0;
+	size_t nCHRMemory = 0;
 };
 
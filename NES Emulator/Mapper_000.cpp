@@ -10,53 +10,15 @@ Mapper_000::~Mapper_000()
 
 void Mapper_000::reset()
 {
+    // 16K or 32K of PRG ROM, a 16K ROM appears twice
+    for (uint8_t i = 0; i < 4; i++)
+        setPRGBank(i, i * 0x2000);
 
+    for (uint8_t i = 0; i < 8; i++)
+        setCHRBank(i, i * 0x0400);
 }
 
-bool Mapper_000::cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data)
+void Mapper_000::cpuMapWrite(uint16_t, uint8_t)
 {
-    if (addr >= 0x8000 && addr <= 0xFFFF)
-    {
-        mapped_addr = addr & (nPRGBanks > 1 ? 0x7FFF : 0x3FFF);
-        return true;
-    }
-
-    return false;
-}
-
-bool Mapper_000::cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data)
-{
-    if (addr >= 0x8000 && addr <= 0xFFFF)
-    {
-        mapped_addr = addr & (nPRGBanks > 1 ? 0x7FFF : 0x3FFF);
-        return true;
-    }
-
-    return false;
-}
-
-bool Mapper_000::ppuMapRead(uint16_t addr, uint32_t& mapped_addr)
-{
-    if (addr >= 0x0000 && addr <= 0x1FFF)
-    {
-        mapped_addr = addr;
-        return true;
-    }
-
-    return false;
-}
-
-bool Mapper_000::ppuMapWrite(uint16_t addr, uint32_t& mapped_addr)
-{
-    if (addr >= 0x0000 && addr <= 0x1FFF)
-    {
-        if (nCHRBanks == 0)
-        {
-            // Treat as RAM
-            mapped_addr = addr;
-            return true;
-        }
-    }
-
-    return false;
+    // No registers, and ROM can not be written
 }
@@ -8,10 +8,7 @@ public:
 	Mapper_000(uint8_t prgBanks, uint8_t chrBanks);
 	~Mapper_000();
 
-	bool cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data) override;
-	bool cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data = 0) override;
-	bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) override;
-	bool ppuMapWrite(uint16_t addr, uint32_t& mapped_addr) override;
+	void cpuMapWrite(uint16_t addr, uint8_t data) override;
 	void reset() override;
 
 	// No local equipment required
@@ -3,6 +3,7 @@
 Mapper_001::Mapper_001(uint8_t prgBanks, uint8_t chrBanks) : Mapper(prgBanks, chrBanks)
 {
 	vRAMStatic.resize(32 * 1024);
+	pPRGRAM = vRAMStatic.data();
 }
 
 
@@ -10,64 +11,8 @@ Mapper_001::~Mapper_001()
 {
 }
 
-bool Mapper_001::cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data)
+void Mapper_001::cpuMapWrite(uint16_t addr, uint8_t data)
 {
-	if (addr >= 0x6000 && addr <= 0x7FFF)
-	{
-		// Read is from static ram on cartridge
-		mapped_addr = 0xFFFFFFFF;
-
-		// Read data from RAM
-		data = vRAMStatic[addr & 0x1FFF];
-
-		// Signal mapper has handled request
-		return true;
-	}
-
-	if (addr >= 0x8000)
-	{
-		if (nControlRegister & 0b01000)
-		{
-			// 16K Mode
-			if (addr >= 0x8000 && addr <= 0xBFFF)
-			{
-				mapped_addr = nPRGBankSelect16Lo * 0x4000 + (addr & 0x3FFF);
-				return true;
-			}
-
-			if (addr >= 0xC000 && addr <= 0xFFFF)
-			{
-				mapped_addr = nPRGBankSelect16Hi * 0x4000 + (addr & 0x3FFF);
-				return true;
-			}
-		}
-		else
-		{
-			// 32K Mode
-			mapped_addr = nPRGBankSelect32 * 0x8000 + (addr & 0x7FFF);
-			return true;
-		}
-	}
-
-
-
-	return false;
-}
-
-bool Mapper_001::cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data)
-{
-	if (addr >= 0x6000 && addr <= 0x7FFF)
-	{
-		// Write is to static ram on cartridge
-		mapped_addr = 0xFFFFFFFF;
-
-		// Write data to RAM
-		vRAMStatic[addr & 0x1FFF] = data;
-
-		// Signal mapper has handled request
-		return true;
-	}
-
 	if (addr >= 0x8000)
 	{
 		if (data & 0x80)
@@ -162,79 +107,86 @@ bool Mapper_001::cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data)
 
 		}
 
+		// Any of the registers may have moved banks about
+		updateBanks();
 	}
-
-	// Mapper has handled write, but do not update ROMs
-	return false;
 }
 
-bool Mapper_001::ppuMapRead(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_001::reset()
 {
-	if (addr < 0x2000)
-	{
-		if (nCHRBanks == 0)
-		{
-			mapped_addr = addr;
-			return true;
-		}
-		else
-		{
-			if (nControlRegister & 0b10000)
-			{
-				// 4K CHR Bank Mode
-				if (addr >= 0x0000 && addr <= 0x0FFF)
-				{
-					mapped_addr = nCHRBankSelect4Lo * 0x1000 + (addr & 0x0FFF);
-					return true;
-				}
+	nControlRegister = 0x1C;
+	nLoadRegister = 0x00;
+	nLoadRegisterCount = 0x00;
 
-				if (addr >= 0x1000 && addr <= 0x1FFF)
-				{
-					mapped_addr = nCHRBankSelect4Hi * 0x1000 + (addr & 0x0FFF);
-					return true;
-				}
-			}
-			else
-			{
-				// 8K CHR Bank Mode
-				mapped_addr = nCHRBankSelect8 * 0x2000 + (addr & 0x1FFF);
-				return true;
-			}
-		}
-	}
+	nCHRBankSelect4Lo = 0;
+	nCHRBankSelect4Hi = 0;
+	nCHRBankSelect8 = 0;
+
+	nPRGBankSelect32 = 0;
+	nPRGBankSelect16Lo = 0;
+	nPRGBankSelect16Hi = nPRGBanks - 1;
 
-	return false;
+	updateBanks();
 }
 
-bool Mapper_001::ppuMapWrite(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_001::updateBanks()
 {
-	if (addr < 0x2000)
+	if (nControlRegister & 0b01000)
+	{
+		// 16K Mode
+		setPRGBank(0, nPRGBankSelect16Lo * 0x4000);
+		setPRGBank(1, nPRGBankSelect16Lo * 0x4000 + 0x2000);
+		setPRGBank(2, nPRGBankSelect16Hi * 0x4000);
+		setPRGBank(3, nPRGBankSelect16Hi * 0x4000 + 0x2000);
+	}
+	else
+	{
+		// 32K Mode
+		for (uint8_t i = 0; i < 4; i++)
+			setPRGBank(i, nPRGBankSelect32 * 0x8000 + i * 0x2000);
+	}
+
+	if (nCHRBanks == 0)
 	{
-		if (nCHRBanks == 0)
+		// 8K of CHR RAM, not banked
+		for (uint8_t i = 0; i < 8; i++)
+			setCHRBank(i, i * 0x0400);
+	}
+	else if (nControlRegister & 0b10000)
+	{
+		// 4K CHR Bank Mode
+		for (uint8_t i = 0; i < 4; i++)
 		{
-			mapped_addr = addr;
-			return true;
+			setCHRBank(i, nCHRBankSelect4Lo * 0x1000 + i * 0x0400);
+			setCHRBank(i + 4, nCHRBankSelect4Hi * 0x1000 + i * 0x0400);
 		}
-
-		return true;
 	}
 	else
-		return false;
+	{
+		// 8K CHR Bank Mode
+		for (uint8_t i = 0; i < 8; i++)
+			setCHRBank(i, nCHRBankSelect8 * 0x2000 + i * 0x0400);
+	}
 }
 
-void Mapper_001::reset()
+void Mapper_001::saveState(StateWriter& state) const
 {
-	nControlRegister = 0x1C;
-	nLoadRegister = 0x00;
-	nLoadRegisterCount = 0x00;
-
-	nCHRBankSelect4Lo = 0;
-	nCHRBankSelect4Hi = 0;
-	nCHRBankSelect8 = 0;
+	Mapper::saveState(state);
+	state.Write(nCHRBankSelect4Lo); state.Write(nCHRBankSelect4Hi); state.Write(nCHRBankSelect8);
+	state.Write(nPRGBankSelect16Lo); state.Write(nPRGBankSelect16Hi); state.Write(nPRGBankSelect32);
+	state.Write(nLoadRegister); state.Write(nLoadRegisterCount); state.Write(nControlRegister);
+	state.Write(mirrormode);
+	state.Write(vRAMStatic.data(), vRAMStatic.size());
+}
 
-	nPRGBankSelect32 = 0;
-	nPRGBankSelect16Lo = 0;
-	nPRGBankSelect16Hi = nPRGBanks - 1;
+void Mapper_001::loadState(StateReader& state)
+{
+	Mapper::loadState(state);
+	state.Read(nCHRBankSelect4Lo); state.Read(nCHRBankSelect4Hi); state.Read(nCHRBankSelect8);
+	state.Read(nPRGBankSelect16Lo); state.Read(nPRGBankSelect16Hi); state.Read(nPRGBankSelect32);
+	state.Read(nLoadRegister); state.Read(nLoadRegisterCount); state.Read(nControlRegister);
+	state.Read(mirrormode);
+	state.Read(vRAMStatic.data(), vRAMStatic.size());
 }
 
 MIRROR Mapper_001::mirror()
@@ -10,14 +10,16 @@ public:
 	Mapper_001(uint8_t prgBanks, uint8_t chrBanks);
 	~Mapper_001();
 
-	bool cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data) override;
-	bool cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data = 0) override;
-	bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) override;
-	bool ppuMapWrite(uint16_t addr, uint32_t& mapped_addr) override;
+	void cpuMapWrite(uint16_t addr, uint8_t data) override;
 	void reset() override;
+
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
 	MIRROR mirror();
 
 private:
+	void updateBanks();
+
 	uint8_t nCHRBankSelect4Lo = 0x00;
 	uint8_t nCHRBankSelect4Hi = 0x00;
 	uint8_t nCHRBankSelect8 = 0x00;
@@ -9,60 +9,45 @@ Mapper_002::~Mapper_002()
 {
 }
 
-bool Mapper_002::cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data)
-{
-	if (addr >= 0x8000 && addr <= 0xBFFF)
-	{
-		mapped_addr = nPRGBankSelectLo * 0x4000 + (addr & 0x3FFF);
-		return true;
-	}
-
-	if (addr >= 0xC000 && addr <= 0xFFFF)
-	{
-		mapped_addr = nPRGBankSelectHi * 0x4000 + (addr & 0x3FFF);
-		return true;
-	}
-
-	return false;
-}
-
-bool Mapper_002::cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data)
+void Mapper_002::cpuMapWrite(uint16_t addr, uint8_t data)
 {
 	if (addr >= 0x8000 && addr <= 0xFFFF)
 	{
 		nPRGBankSelectLo = data & 0x0F;
+		updateBanks();
 	}
+}
 
-	// Mapper has handled write, but do not update ROMs
-	return false;
+void Mapper_002::reset()
+{
+	nPRGBankSelectLo = 0;
+	nPRGBankSelectHi = nPRGBanks - 1;
+	updateBanks();
 }
 
-bool Mapper_002::ppuMapRead(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_002::saveState(StateWriter& state) const
 {
-	if (addr < 0x2000)
-	{
-		mapped_addr = addr;
-		return true;
-	}
-	else
-		return false;
+	Mapper::saveState(state);
+	state.Write(nPRGBankSelectLo);
+	state.Write(nPRGBankSelectHi);
 }
 
-bool Mapper_002::ppuMapWrite(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_002::loadState(StateReader& state)
 {
-	if (addr < 0x2000)
-	{
-		if (nCHRBanks == 0) // Treating as RAM
-		{
-			mapped_addr = addr;
-			return true;
-		}
-	}
-	return false;
+	Mapper::loadState(state);
+	state.Read(nPRGBankSelectLo);
+	state.Read(nPRGBankSelectHi);
 }
 
-void Mapper_002::reset()
+void Mapper_002::updateBanks()
 {
-	nPRGBankSelectLo = 0;
-	nPRGBankSelectHi = nPRGBanks - 1;
+	// Switchable 16K bank at 0x8000, fixed 16K bank at 0xC000
+	setPRGBank(0, nPRGBankSelectLo * 0x4000);
+	setPRGBank(1, nPRGBankSelectLo * 0x4000 + 0x2000);
+	setPRGBank(2, nPRGBankSelectHi * 0x4000);
+	setPRGBank(3, nPRGBankSelectHi * 0x4000 + 0x2000);
+
+	// 8K of CHR, not banked
+	for (uint8_t i = 0; i < 8; i++)
+		setCHRBank(i, i * 0x0400);
 }
\ No newline at end of file
@@ -8,13 +8,15 @@ public:
 	Mapper_002(uint8_t prgBanks, uint8_t chrBanks);
 	~Mapper_002();
 
-	bool cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data) override;
-	bool cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data = 0) override;
-	bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) override;
-	bool ppuMapWrite(uint16_t addr, uint32_t& mapped_addr) override;
+	void cpuMapWrite(uint16_t addr, uint8_t data) override;
 	void reset() override;
 
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
+
 private:
+	void updateBanks();
+
 	uint8_t nPRGBankSelectLo = 0x00;
 	uint8_t nPRGBankSelectHi = 0x00;
 };
\ No newline at end of file
@@ -9,49 +9,41 @@ Mapper_003::~Mapper_003()
 {
 }
 
-bool Mapper_003::cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data)
+void Mapper_003::cpuMapWrite(uint16_t addr, uint8_t data)
 {
 	if (addr >= 0x8000 && addr <= 0xFFFF)
 	{
-		if (nPRGBanks == 1) // 16K ROM 
-			mapped_addr = addr & 0x3FFF;
-		if (nPRGBanks == 2) // 32K ROM
-			mapped_addr = addr & 0x7FFF;
-		return true;
+		nCHRBankSelect = data & 0x03;
+		updateBanks();
 	}
-	else
-		return false;
 }
 
-bool Mapper_003::cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data)
+void Mapper_003::reset()
 {
-	if (addr >= 0x8000 && addr <= 0xFFFF)
-	{
-		nCHRBankSelect = data & 0x03;
-		mapped_addr = addr;
-	}
+	nCHRBankSelect = 0;
+
+	// 16K or 32K of PRG ROM, never switched. A 16K ROM appears twice.
+	for (uint8_t i = 0; i < 4; i++)
+		setPRGBank(i, i * 0x2000);
 
-	// Mapper has handled write, but do not update ROMs
-	return false;
+	updateBanks();
 }
 
-bool Mapper_003::ppuMapRead(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_003::saveState(StateWriter& state) const
 {
-	if (addr < 0x2000)
-	{
-		mapped_addr = nCHRBankSelect * 0x2000 + addr;
-		return true;
-	}
-	else
-		return false;
+	Mapper::saveState(state);
+	state.Write(nCHRBankSelect);
 }
 
-bool Mapper_003::ppuMapWrite(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_003::loadState(StateReader& state)
 {
-	return false;
+	Mapper::loadState(state);
+	state.Read(nCHRBankSelect);
 }
 
-void Mapper_003::reset()
+void Mapper_003::updateBanks()
 {
-	nCHRBankSelect = 0;
+	// Switchable 8K CHR bank
+	for (uint8_t i = 0; i < 8; i++)
+		setCHRBank(i, nCHRBankSelect * 0x2000 + i * 0x0400);
 }
\ No newline at end of file
@@ -9,15 +9,15 @@ public:
 	Mapper_004(uint8_t prgBanks, uint8_t chrBanks);
 	~Mapper_004();
 
-	bool cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data) override;
-	bool cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data = 0) override;
-	bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) override;
-	bool ppuMapWrite(uint16_t addr, uint32_t& mapped_addr) override;
+	void cpuMapWrite(uint16_t addr, uint8_t data) override;
 	void reset() override;
 
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
+
 	bool irqState() override;
-	void irqClear() override;
 
+	bool countsScanlines() const override;
 	void scanline() override;
 	MIRROR mirror() override;
 
@@ -28,9 +28,7 @@ private:
 	bool bCHRInversion = false;
 	MIRROR mirrormode = MIRROR::HORIZONTAL;
 
-	uint32_t pRegister[8];
-	uint32_t pCHRBank[8];
-	uint32_t pPRGBank[4];
+	uint32_t pRegister[8] = { 0 };
 
 	bool bIRQActive = false;
 	bool bIRQEnable = false;
@@ -9,47 +9,43 @@ Mapper_066::~Mapper_066()
 {
 }
 
-bool Mapper_066::cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data)
-{
-	if (addr >= 0x8000 && addr <= 0xFFFF)
-	{
-		mapped_addr = nPRGBankSelect * 0x8000 + (addr & 0x7FFF);
-		return true;
-	}
-	else
-		return false;
-}
-
-bool Mapper_066::cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data)
+void Mapper_066::cpuMapWrite(uint16_t addr, uint8_t data)
 {
 	if (addr >= 0x8000 && addr <= 0xFFFF)
 	{
 		nCHRBankSelect = data & 0x03;
 		nPRGBankSelect = (data & 0x30) >> 4;
+		updateBanks();
 	}
+}
 
-	// Mapper has handled write, but do not update ROMs
-	return false;
+void Mapper_066::reset()
+{
+	nCHRBankSelect = 0;
+	nPRGBankSelect = 0;
+	updateBanks();
 }
 
-bool Mapper_066::ppuMapRead(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_066::saveState(StateWriter& state) const
 {
-	if (addr < 0x2000)
-	{
-		mapped_addr = nCHRBankSelect * 0x2000 + addr;
-		return true;
-	}
-	else
-		return false;
+	Mapper::saveState(state);
+	state.Write(nCHRBankSelect);
+	state.Write(nPRGBankSelect);
 }
 
-bool Mapper_066::ppuMapWrite(uint16_t addr, uint32_t& mapped_addr)
+void Mapper_066::loadState(StateReader& state)
 {
-	return false;
+	Mapper::loadState(state);
+	state.Read(nCHRBankSelect);
+	state.Read(nPRGBankSelect);
 }
 
-void Mapper_066::reset()
+void Mapper_066::updateBanks()
 {
-	nCHRBankSelect = 0;
-	nPRGBankSelect = 0;
+	// Switchable 32K PRG bank and 8K CHR bank
+	for (uint8_t i = 0; i < 4; i++)
+		setPRGBank(i, nPRGBankSelect * 0x8000 + i * 0x2000);
+
+	for (uint8_t i = 0; i < 8; i++)
+		setCHRBank(i, nCHRBankSelect * 0x2000 + i * 0x0400);
 }
\ No newline at end of file
@@ -8,13 +8,15 @@ public:
 	Mapper_066(uint8_t prgBanks, uint8_t chrBanks);
 	~Mapper_066();
 
-	bool cpuMapRead(uint16_t addr, uint32_t& mapped_addr, uint8_t& data) override;
-	bool cpuMapWrite(uint16_t addr, uint32_t& mapped_addr, uint8_t data = 0) override;
-	bool ppuMapRead(uint16_t addr, uint32_t& mapped_addr) override;
-	bool ppuMapWrite(uint16_t addr, uint32_t& mapped_addr) override;
+	void cpuMapWrite(uint16_t addr, uint8_t data) override;
 	void reset() override;
 
+	void saveState(StateWriter& state) const override;
+	void loadState(StateReader& state) override;
+
 private:
+	void updateBanks();
+
 	uint8_t nCHRBankSelect = 0x00;
 	uint8_t nPRGBankSelect = 0x00;
 };
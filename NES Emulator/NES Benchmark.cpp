@@ -0,0 +1,441 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <cstdlib>
+#include <random>
+
+#include "bus.h"
+#include "LockstepCPU.h"
+
+// Benchmarks for the emulation core. Each ROM is run headless for a fixed
+// number of frames, both catching up and clocked per cycle, and then each
+// device's clock, and the cartridge's CPU reads, are timed on their own
+// against a console left as that ROM leaves it. Every measurement is repeated
+// and the fastest kept, as anything slower is the host getting in the way.
+// The results are written as JSON, so runs on different commits can be kept
+// and compared by a script. ROMs with no mapper are also run on LockstepCPU,
+// which has to match olc6502 lane for lane, or the benchmark fails.
+
+struct BenchmarkOptions
+{
+	std::vector<std::string> vRomFiles;
+	std::string sOutFile;		// JSON output, empty for stdout
+	uint32_t nFrames = 600;
+	uint32_t nRepeats = 3;
+	uint32_t nSampleRate = 44100;
+	uint32_t nWarmupFrames = 120;	// Run before the microbenchmarks, so the game is doing something
+	uint32_t nMicroClocks = 10000000;
+	uint32_t nLanes = 16;	// For LockstepCPU, 0 to leave it out
+};
+
+class NES_Benchmark
+{
+public:
+	NES_Benchmark(const BenchmarkOptions& o) : opt(o) {}
+
+	bool Run()
+	{
+		std::ostringstream json;
+		json << "{\n"
+			<< "  \"frames\": " << opt.nFrames << ",\n"
+			<< "  \"repeats\": " << opt.nRepeats << ",\n"
+			<< "  \"sample_rate\": " << opt.nSampleRate << ",\n"
+			<< "  \"roms\": [";
+
+		for (size_t i = 0; i < opt.vRomFiles.size(); i++)
+		{
+			const std::string& sRomFile = opt.vRomFiles[i];
+			auto image = RomCache::Load(sRomFile);
+			if (image == nullptr)
+			{
+				std::cerr << "Could not load ROM: " << sRomFile << "\n";
+				return false;
+			}
+
+			json << (i > 0 ? "," : "") << "\n    {\n"
+				<< "      \"rom\": \"" << Escape(sRomFile) << "\",\n"
+				<< "      \"catch_up\": " << Frames(image, true) << ",\n"
+				<< "      \"per_cycle\": " << Frames(image, false) << ",\n"
+				<< "      \"bus_clock\": " << BusClock(image) << ",\n"
+				<< "      \"micro\": " << Micro(image) << ",\n"
+				<< "      \"lockstep\": " << Lockstep(image) << "\n"
+				<< "    }";
+		}
+
+		json << "\n  ]\n}\n";
+
+		if (opt.sOutFile.empty())
+			std::cout << json.str();
+		else
+		{
+			std::ofstream ofs(opt.sOutFile);
+			ofs << json.str();
+			if (!ofs.good())
+			{
+				std::cerr << "Could not write results: " << opt.sOutFile << "\n";
+				return false;
+			}
+		}
+
+		if (nLockstepMismatched > 0)
+		{
+			std::cerr << "LockstepCPU differs from olc6502 in " << nLockstepMismatched << " lanes\n";
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	BenchmarkOptions opt;
+	std::unique_ptr<Bus> nes;
+	volatile uint8_t nSink = 0x00; // Somewhere for results to go, so they are not optimised away
+	uint32_t nLockstepMismatched = 0;
+
+	// The PPU draws 262 scanlines of 341 dots a frame, and the master clock
+	// is one dot. The CPU runs on every third.
+	static constexpr double dClocksPerFrame = 341.0 * 262.0;
+
+	// A console as it is at power on, so every run starts the same
+	void Start(const std::shared_ptr<const RomImage>& image, bool bCatchUp)
+	{
+		nes = std::make_unique<Bus>();
+		nes->insertCartridge(std::make_shared<Cartridge>(image));
+		nes->SetCatchUp(bCatchUp);
+		if (opt.nSampleRate > 0)
+			nes->SetSampleFrequency(opt.nSampleRate);
+		nes->reset();
+	}
+
+	// Seconds the fastest of the repeats took
+	double Fastest(const std::function<void()>& prepare, const std::function<void()>& measure)
+	{
+		double dBest = 0.0;
+		for (uint32_t r = 0; r < std::max(1u, opt.nRepeats); r++)
+		{
+			prepare();
+			auto tp1 = std::chrono::steady_clock::now();
+			measure();
+			auto tp2 = std::chrono::steady_clock::now();
+			double dElapsed = std::chrono::duration<double>(tp2 - tp1).count();
+			if (r == 0 || dElapsed < dBest)
+				dBest = dElapsed;
+		}
+		return dBest;
+	}
+
+	// Whole frames, as the headless runner does them
+	std::string Frames(const std::shared_ptr<const RomImage>& image, bool bCatchUp)
+	{
+		double dSeconds = Fastest(
+			[&] { Start(image, bCatchUp); },
+			[&]
+			{
+				for (uint32_t f = 0; f < opt.nFrames; f++)
+				{
+					nes->frame();
+					nes->vAudioSamples.clear();
+				}
+			});
+
+		double dClocks = dClocksPerFrame * opt.nFrames;
+		std::ostringstream s;
+		s << "{ \"seconds\": " << dSeconds
+			<< ", \"fps\": " << opt.nFrames / dSeconds
+			<< ", \"cpu_cycles_per_second\": " << dClocks / 3.0 / dSeconds
+			<< ", \"master_clocks_per_second\": " << dClocks / dSeconds << " }";
+		return s.str();
+	}
+
+	// Bus::clock() called directly, a master clock at a time
+	std::string BusClock(const std::shared_ptr<const RomImage>& image)
+	{
+		uint64_t nClocks = 0;
+		double dSeconds = Fastest(
+			[&] { Start(image, false); nClocks = 0; },
+			[&]
+			{
+				Bus& bus = *nes;
+				for (uint32_t f = 0; f < opt.nFrames; f++)
+				{
+					do { bus.clock(); nClocks++; } while (!bus.ppu.frame_complete);
+					bus.ppu.frame_complete = false;
+					bus.FlushAudio();
+					bus.vAudioSamples.clear();
+				}
+			});
+
+		std::ostringstream s;
+		s << "{ \"clocks\": " << nClocks
+			<< ", \"seconds\": " << dSeconds
+			<< ", \"ns_per_clock\": " << dSeconds * 1e9 / nClocks << " }";
+		return s.str();
+	}
+
+	// Each device on its own, clocked against a console left as the ROM
+	// leaves it after warming up, so the CPU is running the game's code
+	// and the PPU is rendering. Nothing else is clocked, so the devices
+	// drift apart from what a real console would do, but the work each
+	// clock does is still typical.
+	std::string Micro(const std::shared_ptr<const RomImage>& image)
+	{
+		Start(image, true);
+		Bus& bus = *nes;
+		for (uint32_t f = 0; f < opt.nWarmupFrames; f++)
+			bus.frame();
+		bus.vAudioSamples.clear();
+
+		std::vector<uint8_t> vWarm;
+		bus.saveState(vWarm);
+		auto restore = [&] { bus.loadState(vWarm); };
+
+		const uint32_t nClocks = opt.nMicroClocks;
+		const uint32_t nChunk = (uint32_t)dClocksPerFrame;
+		std::ostringstream s;
+		s << "{ ";
+
+		auto result = [&](const char* sName, double dSeconds, bool bLast = false)
+		{
+			s << "\"" << sName << "\": { \"calls\": " << nClocks
+				<< ", \"ns_per_call\": " << dSeconds * 1e9 / nClocks << " }" << (bLast ? " " : ", ");
+		};
+
+		result("olc6502::clock", Fastest(restore, [&]
+			{
+				for (uint32_t i = 0; i < nClocks; i++)
+					bus.cpu.clock();
+			}));
+
+		result("olc2C02::clock", Fastest(restore, [&]
+			{
+				for (uint32_t i = 0; i < nClocks; i++)
+				{
+					bus.ppu.clock();
+					bus.ppu.frame_complete = false;
+				}
+			}));
+
+		// Audio is taken off a frame at a time, as the console would,
+		// and only the clocking itself is timed
+		double dApu = 0.0;
+		for (uint32_t r = 0; r < std::max(1u, opt.nRepeats); r++)
+		{
+			restore();
+			double dElapsed = 0.0;
+			for (uint32_t nDone = 0; nDone < nClocks; )
+			{
+				uint32_t n = std::min(nChunk, nClocks - nDone);
+				auto tp1 = std::chrono::steady_clock::now();
+				for (uint32_t i = 0; i < n; i++)
+					bus.apu.clock();
+				auto tp2 = std::chrono::steady_clock::now();
+				dElapsed += std::chrono::duration<double>(tp2 - tp1).count();
+				nDone += n;
+				bus.FlushAudio();
+				bus.vAudioSamples.clear();
+			}
+			if (r == 0 || dElapsed < dApu)
+				dApu = dElapsed;
+		}
+		result("olc2A03::clock", dApu);
+
+		// Reads spread across PRG space, as code and data would be
+		result("Cartridge::cpuRead", Fastest(restore, [&]
+			{
+				uint8_t data = 0x00, nSum = 0x00;
+				for (uint32_t i = 0; i < nClocks; i++)
+				{
+					bus.cart->cpuRead(0x8000 | ((i * 0x0101) & 0x7FFF), data);
+					nSum += data;
+				}
+				nSink = nSum;
+			}), true);
+
+		s << "}";
+		return s.str();
+	}
+
+	// Each lane's devices, a Bus which is never clocked
+	struct LaneIO : LockstepCPU::IO
+	{
+		std::vector<std::unique_ptr<Bus>> vBuses;
+		uint8_t cpuRead(size_t nLane, uint16_t addr) override { return vBuses[nLane]->cpuRead(addr); }
+		void cpuWrite(size_t nLane, uint16_t addr, uint8_t data) override { vBuses[nLane]->cpuWrite(addr, data); }
+	};
+
+	// LockstepCPU against as many olc6502s, each running a frame's worth of
+	// cycles then an NMI, every frame. Each lane's RAM starts out different
+	// and each has its own controller input, so the lanes have reasons to
+	// part ways. Only the CPUs run: what either reads outside RAM and ROM
+	// comes from a Bus of the lane's own, which is never clocked.
+	std::string Lockstep(const std::shared_ptr<const RomImage>& image)
+	{
+		if (opt.nLanes == 0 || image->nMapperID != 0)
+			return "null";
+
+		const size_t nLanes = opt.nLanes;
+		const uint32_t nCyclesPerFrame = (uint32_t)(dClocksPerFrame / 3.0);
+
+		std::vector<uint8_t> vSeed(nLanes * 2048);
+		std::mt19937 rng(1);
+		for (size_t l = 0; l < nLanes; l++)
+			for (size_t a = 0; a < 2048; a++)
+				vSeed[l * 2048 + a] = (rng() % 4 == 0) ? (uint8_t)l : 0x00;
+
+		auto Lane = [&]
+		{
+			auto bus = std::make_unique<Bus>();
+			bus->insertCartridge(std::make_shared<Cartridge>(image));
+			bus->reset();
+			return bus;
+		};
+
+		LaneIO io;
+		std::unique_ptr<LockstepCPU> lockstep;
+		double dLockstep = Fastest(
+			[&]
+			{
+				io.vBuses.clear();
+				for (size_t l = 0; l < nLanes; l++)
+					io.vBuses.push_back(Lane());
+				lockstep = std::make_unique<LockstepCPU>(image, nLanes, &io);
+				lockstep->reset();
+				for (size_t l = 0; l < nLanes; l++)
+				{
+					for (uint16_t a = 0; a < 2048; a++)
+						lockstep->ram(l, a) = vSeed[l * 2048 + a];
+					lockstep->controller[0][l] = (uint8_t)(l * 37);
+				}
+			},
+			[&]
+			{
+				for (uint32_t f = 0; f < opt.nFrames; f++)
+				{
+					lockstep->run(nCyclesPerFrame);
+					for (size_t l = 0; l < nLanes; l++)
+						lockstep->nmi(l);
+				}
+			});
+
+		// olc6502 counts down the cycles of its current instruction rather
+		// than up, so its elapsed cycles are added up here the same way
+		std::vector<std::unique_ptr<Bus>> vLanes;
+		std::vector<uint32_t> vCycles;
+		double dScalar = Fastest(
+			[&]
+			{
+				vLanes.clear();
+				vCycles.assign(nLanes, 8);
+				for (size_t l = 0; l < nLanes; l++)
+				{
+					vLanes.push_back(Lane());
+					std::copy(vSeed.begin() + l * 2048, vSeed.begin() + (l + 1) * 2048, vLanes[l]->cpuRAM.begin());
+					vLanes[l]->controller[0] = (uint8_t)(l * 37);
+				}
+			},
+			[&]
+			{
+				for (size_t l = 0; l < nLanes; l++)
+				{
+					olc6502& cpu = vLanes[l]->cpu;
+					for (uint32_t f = 0; f < opt.nFrames; f++)
+					{
+						uint32_t nTarget = vCycles[l] + nCyclesPerFrame;
+						while ((int32_t)(vCycles[l] - nTarget) < 0)
+							vCycles[l] += cpu.step();
+						cpu.nmi();
+						vCycles[l] += 8;
+					}
+				}
+			});
+
+		uint32_t nMismatched = 0;
+		for (size_t l = 0; l < nLanes; l++)
+		{
+			const olc6502& cpu = vLanes[l]->cpu;
+			bool bSame = cpu.accumulator == lockstep->accumulator[l] && cpu.x == lockstep->x[l] && cpu.y == lockstep->y[l]
+				&& cpu.stkp == lockstep->stkp[l] && cpu.pc == lockstep->pc[l] && cpu.status == lockstep->status[l]
+				&& vCycles[l] == lockstep->cycles[l];
+			for (uint16_t a = 0; a < 2048 && bSame; a++)
+				bSame = vLanes[l]->cpuRAM[a] == lockstep->ram(l, a);
+			nMismatched += bSame ? 0 : 1;
+		}
+		nLockstepMismatched += nMismatched;
+
+		std::ostringstream s;
+		s << "{ \"lanes\": " << nLanes
+			<< ", \"lanes_per_pass\": " << (lockstep->nPasses > 0 ? (double)lockstep->nLaneInstructions / lockstep->nPasses : 0.0)
+			<< ", \"seconds\": " << dLockstep
+			<< ", \"olc6502_seconds\": " << dScalar
+			<< ", \"mismatched\": " << nMismatched << " }";
+		return s.str();
+	}
+
+	static std::string Escape(const std::string& str)
+	{
+		std::string out;
+		for (char c : str)
+		{
+			if (c == '"' || c == '\\') out += '\\';
+			out += c;
+		}
+		return out;
+	}
+};
+
+static void Usage()
+{
+	std::cerr <<
+		"Usage: \"NES Benchmark\" [rom.nes ...] [options]\n"
+		"  ROMs default to nestest.nes\n"
+		"  -frames N        Number of frames to emulate for each run (default 600)\n"
+		"  -repeat N        Runs of each benchmark, the fastest is reported (default 3)\n"
+		"  -rate N          Audio sample rate, 0 disables audio (default 44100)\n"
+		"  -warmup N        Frames to run before the microbenchmarks (default 120)\n"
+		"  -clocks N        Calls per microbenchmark (default 10000000)\n"
+		"  -lanes N         Lanes to run on LockstepCPU, 0 leaves it out (default 16)\n"
+		"  -out FILE        Write the JSON results to FILE rather than stdout\n";
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions opt;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool bHasValue = i + 1 < argc;
+
+		if (arg == "-frames" && bHasValue) opt.nFrames = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-repeat" && bHasValue) opt.nRepeats = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-rate" && bHasValue) opt.nSampleRate = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-warmup" && bHasValue) opt.nWarmupFrames = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-clocks" && bHasValue) opt.nMicroClocks = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-lanes" && bHasValue) opt.nLanes = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-out" && bHasValue) opt.sOutFile = argv[++i];
+		else if (arg[0] != '-') opt.vRomFiles.push_back(arg);
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (opt.vRomFiles.empty())
+		opt.vRomFiles.push_back("nestest.nes");
+
+	if (opt.nFrames == 0 || opt.nMicroClocks == 0)
+	{
+		Usage();
+		return 1;
+	}
+
+	NES_Benchmark benchmark(opt);
+	return benchmark.Run() ? 0 : 1;
+}
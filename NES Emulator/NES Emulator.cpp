@@ -1,8 +1,14 @@
 #include <iostream>
 #include <sstream>
 #include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
-#include "Bus.h"
+#include "bus.h"
+#include "InputMovie.h"
+#include "TripleBuffer.h"
+#include "RingBuffer.h"
 
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
@@ -23,11 +29,51 @@ private:
 	bool bEmulationRun = false;
 	float fResidualTime = 0.0f;
 
-	uint8_t nSelectedPalette = 0x00;
+	std::atomic<uint8_t> nSelectedPalette{ 0x00 };
+
+	// The NES runs on a thread of its own, and is only ever touched by it
+	// once running. Everything drawn is captured at the end of each frame
+	// and handed over through a triple buffer, and audio goes to the sound
+	// device through a ring buffer. Input goes the other way as atomics.
+	struct sFrame
+	{
+		uint8_t screen[256 * 240];
+		uint8_t palette[32];
+		std::vector<olc2C02::Pixel> pattern[2];
+
+		uint8_t a = 0, x = 0, y = 0, stkp = 0, status = 0;
+		uint16_t pc = 0;
+
+		uint16_t visual[3] = { 0 };
+
+		bool bRecording = false;
+	};
+
+	std::thread threadEmulation;
+	std::atomic<bool> bEmulationQuit{ false };
+	std::atomic<bool> bResetRequested{ false };
+	std::atomic<uint8_t> nControllerInput{ 0x00 };
+	std::atomic<bool> bRecordToggled{ false };
+	TripleBuffer<sFrame> frames;
+	RingBuffer<float, 8192> ringAudio;
+	float fLastSample = 0.0f;
+
+	// Emulation runs this far ahead of the sound device, about 3 frames
+	static constexpr size_t nAudioLead = 2048;
 
 	std::list<uint16_t> audio[4];
 	float fAccumulatedTime = 0.0f;
 
+	// Input movie being recorded, by the emulation thread
+	InputMovie movie;
+	bool bRecording = false;
+	const std::string sMovieFile = "movie.nesm";
+
+	// The emulation core renders into its own images, these are the
+	// engine side copies that actually get drawn
+	olc::Sprite sprScreen{ 256, 240 };
+	olc::Sprite sprPatternTable[2] = { { 128, 128 }, { 128, 128 } };
+
 private:
 	// Support Utilities
 	std::map<uint16_t, std::string> mapAsm;
@@ -57,27 +103,37 @@ private:
 	}
 
 	void DrawCpu(int x, int y)
+	{
+		DrawCpu(x, y, nes.cpu.status, nes.cpu.pc, nes.cpu.accumulator, nes.cpu.x, nes.cpu.y, nes.cpu.stkp);
+	}
+
+	void DrawCpu(int x, int y, uint8_t cpu_status, uint16_t pc, uint8_t a, uint8_t rx, uint8_t ry, uint8_t stkp)
 	{
 		std::string status = "STATUS: ";
 		DrawString(x, y, "STATUS:", olc::WHITE);
-		DrawString(x + 64, y, "N", nes.cpu.status & olc6502::N ? olc::GREEN : olc::RED);
-		DrawString(x + 80, y, "V", nes.cpu.status & olc6502::V ? olc::GREEN : olc::RED);
-		DrawString(x + 96, y, "-", nes.cpu.status & olc6502::U ? olc::GREEN : olc::RED);
-		DrawString(x + 112, y, "B", nes.cpu.status & olc6502::B ? olc::GREEN : olc::RED);
-		DrawString(x + 128, y, "D", nes.cpu.status & olc6502::D ? olc::GREEN : olc::RED);
-		DrawString(x + 144, y, "I", nes.cpu.status & olc6502::I ? olc::GREEN : olc::RED);
-		DrawString(x + 160, y, "Z", nes.cpu.status & olc6502::Z ? olc::GREEN : olc::RED);
-		DrawString(x + 178, y, "C", nes.cpu.status & olc6502::C ? olc::GREEN : olc::RED);
-		DrawString(x, y + 10, "PC: $" + hex(nes.cpu.pc, 4));
-		DrawString(x, y + 20, "A: $" + hex(nes.cpu.accumulator, 2) + "  [" + std::to_string(nes.cpu.accumulator) + "]");
-		DrawString(x, y + 30, "X: $" + hex(nes.cpu.x, 2) + "  [" + std::to_string(nes.cpu.x) + "]");
-		DrawString(x, y + 40, "Y: $" + hex(nes.cpu.y, 2) + "  [" + std::to_string(nes.cpu.y) + "]");
-		DrawString(x, y + 50, "Stack P: $" + hex(nes.cpu.stkp, 4));
+		DrawString(x + 64, y, "N", cpu_status & olc6502::N ? olc::GREEN : olc::RED);
+		DrawString(x + 80, y, "V", cpu_status & olc6502::V ? olc::GREEN : olc::RED);
+		DrawString(x + 96, y, "-", cpu_status & olc6502::U ? olc::GREEN : olc::RED);
+		DrawString(x + 112, y, "B", cpu_status & olc6502::B ? olc::GREEN : olc::RED);
+		DrawString(x + 128, y, "D", cpu_status & olc6502::D ? olc::GREEN : olc::RED);
+		DrawString(x + 144, y, "I", cpu_status & olc6502::I ? olc::GREEN : olc::RED);
+		DrawString(x + 160, y, "Z", cpu_status & olc6502::Z ? olc::GREEN : olc::RED);
+		DrawString(x + 178, y, "C", cpu_status & olc6502::C ? olc::GREEN : olc::RED);
+		DrawString(x, y + 10, "PC: $" + hex(pc, 4));
+		DrawString(x, y + 20, "A: $" + hex(a, 2) + "  [" + std::to_string(a) + "]");
+		DrawString(x, y + 30, "X: $" + hex(rx, 2) + "  [" + std::to_string(rx) + "]");
+		DrawString(x, y + 40, "Y: $" + hex(ry, 2) + "  [" + std::to_string(ry) + "]");
+		DrawString(x, y + 50, "Stack P: $" + hex(stkp, 4));
 	}
 
 	void DrawCode(int x, int y, int nLines)
 	{
-		auto it_a = mapAsm.find(nes.cpu.pc);
+		DrawCode(x, y, nLines, nes.cpu.pc);
+	}
+
+	void DrawCode(int x, int y, int nLines, uint16_t pc)
+	{
+		auto it_a = mapAsm.find(pc);
 		int nLineY = (nLines >> 1) * 10 + y;
 		if (it_a != mapAsm.end())
 		{
@@ -92,7 +148,7 @@ private:
 			}
 		}
 
-		it_a = mapAsm.find(nes.cpu.pc);
+		it_a = mapAsm.find(pc);
 		nLineY = (nLines >> 1) * 10 + y;
 		if (it_a != mapAsm.end())
 		{
@@ -107,6 +163,39 @@ private:
 		}
 	}
 
+	// Copy an image produced by the PPU into an engine sprite. Both share
+	// the same RGBA memory layout so this is a straight block copy.
+	olc::Sprite* Present(olc::Sprite& dst, olc2C02::Sprite& src)
+	{
+		std::memcpy(dst.GetData(), src.GetData(), src.pColData.size() * sizeof(olc2C02::Pixel));
+		return &dst;
+	}
+
+	// The emulated screen is held as colour indices, convert it straight
+	// into the engine sprite rather than going through GetScreen()
+	olc::Sprite* PresentScreen()
+	{
+		return PresentScreen(nes.ppu.GetScreenIndices());
+	}
+
+	olc::Sprite* PresentScreen(const uint8_t* pIndices)
+	{
+		nes.ppu.ConvertScreen(pIndices, (olc2C02::Pixel*)sprScreen.GetData());
+		return &sprScreen;
+	}
+
+	olc::Sprite* Present(olc::Sprite& dst, const std::vector<olc2C02::Pixel>& src)
+	{
+		if (!src.empty())
+			std::memcpy(dst.GetData(), src.data(), src.size() * sizeof(olc2C02::Pixel));
+		return &dst;
+	}
+
+	olc::Pixel Colour(const olc2C02::Pixel& p)
+	{
+		return olc::Pixel(p.r, p.g, p.b, p.a);
+	}
+
 	void DrawAudio(int channel, int x, int y)
 	{
 		FillRect(x, y, 120, 120, olc::BLACK);
@@ -120,17 +209,99 @@ private:
 
 	static NES_Emulator* pInstance; // Static Variable that will point to "this"
 
+	// The sound device only consumes what the emulation thread has produced.
+	// Should it ever run dry, hold the last sample rather than click.
 	static float SoundOut(int nChannel, float fGlobalTime, float fTimeStep)
 	{
 		if (nChannel == 0)
 		{
-			while (!pInstance->nes.clock()) {};
-			return static_cast<float>(pInstance->nes.dAudioSample);
+			pInstance->ringAudio.Pop(pInstance->fLastSample);
+			return pInstance->fLastSample;
 		}
 		else
 			return 0.0f;
 	}
 
+	void EmulationThread()
+	{
+		while (!bEmulationQuit)
+		{
+			// The sound device sets the pace, stay a little ahead of it
+			if (ringAudio.Size() > nAudioLead)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			if (bRecordToggled.exchange(false))
+				ToggleRecording();
+
+			bool bReset = bResetRequested.exchange(false);
+			if (bReset)
+				nes.reset();
+
+			nes.controller[0] = nControllerInput;
+
+			if (bRecording)
+			{
+				InputMovie::sFrame input;
+				input.controller[0] = nes.controller[0];
+				input.controller[1] = nes.controller[1];
+				input.flags = bReset ? InputMovie::RESET : 0x00;
+				movie.Record(input);
+			}
+
+			nes.frame();
+
+			for (float s : nes.vAudioSamples)
+				ringAudio.Push(s);
+			nes.vAudioSamples.clear();
+
+			// Capture everything the presenter wants to draw
+			sFrame& frame = frames.Back();
+			std::memcpy(frame.screen, nes.ppu.GetScreenIndices(), sizeof(frame.screen));
+			for (uint8_t i = 0; i < 32; i++)
+				frame.palette[i] = nes.ppu.GetIndexFromPaletteRam(i >> 2, i & 0x03);
+			for (uint8_t i = 0; i < 2; i++)
+				frame.pattern[i] = nes.ppu.GetPatternTable(i, nSelectedPalette).pColData;
+
+			frame.a = nes.cpu.accumulator;
+			frame.x = nes.cpu.x;
+			frame.y = nes.cpu.y;
+			frame.stkp = nes.cpu.stkp;
+			frame.status = nes.cpu.status;
+			frame.pc = nes.cpu.pc;
+
+			frame.visual[0] = nes.apu.pulse1_visual;
+			frame.visual[1] = nes.apu.pulse2_visual;
+			frame.visual[2] = nes.apu.noise_visual;
+
+			frame.bRecording = bRecording;
+
+			frames.Publish();
+		}
+	}
+
+	// Recording starts from wherever the console is, so the movie starts
+	// from a save state of it, and is written out when recording stops
+	void ToggleRecording()
+	{
+		if (!bRecording)
+		{
+			std::vector<uint8_t> vState;
+			nes.saveState(vState);
+			movie = InputMovie(cart->GetImage()->nHash);
+			movie.SetStartState(std::move(vState));
+			bRecording = true;
+		}
+		else
+		{
+			if (!movie.Save(sMovieFile))
+				std::cerr << "Could not write movie: " << sMovieFile << "\n";
+			bRecording = false;
+		}
+	}
+
 	bool OnUserCreate() override
 	{
 		// Load the cartridge
@@ -151,6 +322,7 @@ private:
 		}
 
 		// Reset NES
+		nes.SetCatchUp(true);
 		nes.reset();
 
 		// Initialise PGEX sound system, and give it a function to 
@@ -160,6 +332,9 @@ private:
 		olc::SOUND::InitialiseAudio(44100, 1, 8, 512);
 		olc::SOUND::SetUserSynthFunction(SoundOut);
 
+		// From here on only the emulation thread touches the NES
+		threadEmulation = std::thread(&NES_Emulator::EmulationThread, this);
+
 		return true;
 	}
 
@@ -167,6 +342,10 @@ private:
 	// it when the application terminates
 	bool OnUserDestroy() override
 	{
+		bEmulationQuit = true;
+		if (threadEmulation.joinable())
+			threadEmulation.join();
+
 		olc::SOUND::DestroyAudio();
 		return true;
 	}
@@ -249,14 +428,14 @@ private:
 	//	for (int p = 0; p < 8; p++) // For each palette
 	//		for (int s = 0; s < 4; s++) // For each index
 	//			FillRect(516 + p * (nSwatchSize * 5) + s * nSwatchSize, 340,
-	//				nSwatchSize, nSwatchSize, nes.ppu.GetColourFromPaletteRam(p, s));
+	//				nSwatchSize, nSwatchSize, Colour(nes.ppu.GetColourFromPaletteRam(p, s)));
 
 	//	DrawRect(516 + nSelectedPalette * (nSwatchSize * 5) - 1, 339, (nSwatchSize * 4), nSwatchSize, olc::WHITE);
 
-	//	DrawSprite(516, 348, &nes.ppu.GetPatternTable(0, nSelectedPalette));
-	//	DrawSprite(648, 348, &nes.ppu.GetPatternTable(1, nSelectedPalette));
+	//	DrawSprite(516, 348, Present(sprPatternTable[0], nes.ppu.GetPatternTable(0, nSelectedPalette)));
+	//	DrawSprite(648, 348, Present(sprPatternTable[1], nes.ppu.GetPatternTable(1, nSelectedPalette)));
 
-	//	DrawSprite(0, 0, &nes.ppu.GetScreen(), 2);
+	//	DrawSprite(0, 0, Present(sprScreen, nes.ppu.GetScreen()), 2);
 
 	//	return true;
 	//}
@@ -267,48 +446,46 @@ private:
 	// and updates the display
 	bool EmulatorUpdateWithAudio(float fElapsedTime)
 	{
+		// Pick up the latest frame, if there is a new one
+		frames.Update();
+		const sFrame& frame = frames.Front();
+
 		// Sample audio channel output roughly once per frame
 		fAccumulatedTime += fElapsedTime;
 		if (fAccumulatedTime >= 1.0f / 60.0f)
 		{
 			fAccumulatedTime -= (1.0f / 60.0f);
 			audio[0].pop_front();
-			audio[0].push_back(nes.apu.pulse1_visual);
+			audio[0].push_back(frame.visual[0]);
 			audio[1].pop_front();
-			audio[1].push_back(nes.apu.pulse2_visual);
+			audio[1].push_back(frame.visual[1]);
 			audio[2].pop_front();
-			audio[2].push_back(nes.apu.noise_visual);
+			audio[2].push_back(frame.visual[2]);
 		}
 
 
 		Clear(olc::DARK_BLUE);
 
 		// Handle input for controller in port #1
-		nes.controller[0] = 0x00;
-		nes.controller[0] |= GetKey(olc::Key::A).bHeld ? 0x80 : 0x00;     // A Button
-		nes.controller[0] |= GetKey(olc::Key::B).bHeld ? 0x40 : 0x00;     // B Button
-		nes.controller[0] |= GetKey(olc::Key::S).bHeld ? 0x20 : 0x00;     // Select
-		nes.controller[0] |= GetKey(olc::Key::D).bHeld ? 0x10 : 0x00;     // Start
-		nes.controller[0] |= GetKey(olc::Key::UP).bHeld ? 0x08 : 0x00;
-		nes.controller[0] |= GetKey(olc::Key::DOWN).bHeld ? 0x04 : 0x00;
-		nes.controller[0] |= GetKey(olc::Key::LEFT).bHeld ? 0x02 : 0x00;
-		nes.controller[0] |= GetKey(olc::Key::RIGHT).bHeld ? 0x01 : 0x00;
-
-		if (GetKey(olc::Key::R).bPressed) nes.reset();
-		if (GetKey(olc::Key::P).bPressed) (++nSelectedPalette) &= 0x07;
-
-		DrawCpu(516, 2);
-		DrawCode(516, 72, 26);
-
-		// Draw OAM Contents (first 26 out of 64) ======================================
-		/*for (int i = 0; i < 26; i++)
-		{
-			std::string s = hex(i, 2) + ": (" + std::to_string(nes.ppu.pOAM[i * 4 + 3])
-				+ ", " + std::to_string(nes.ppu.pOAM[i * 4 + 0]) + ") "
-				+ "ID: " + hex(nes.ppu.pOAM[i * 4 + 1], 2) +
-				+" AT: " + hex(nes.ppu.pOAM[i * 4 + 2], 2);
-			DrawString(516, 72 + i * 10, s);
-		}*/
+		uint8_t input = 0x00;
+		input |= GetKey(olc::Key::A).bHeld ? 0x80 : 0x00;     // A Button
+		input |= GetKey(olc::Key::B).bHeld ? 0x40 : 0x00;     // B Button
+		input |= GetKey(olc::Key::S).bHeld ? 0x20 : 0x00;     // Select
+		input |= GetKey(olc::Key::D).bHeld ? 0x10 : 0x00;     // Start
+		input |= GetKey(olc::Key::UP).bHeld ? 0x08 : 0x00;
+		input |= GetKey(olc::Key::DOWN).bHeld ? 0x04 : 0x00;
+		input |= GetKey(olc::Key::LEFT).bHeld ? 0x02 : 0x00;
+		input |= GetKey(olc::Key::RIGHT).bHeld ? 0x01 : 0x00;
+		nControllerInput = input;
+
+		if (GetKey(olc::Key::R).bPressed) bResetRequested = true;
+		if (GetKey(olc::Key::P).bPressed) nSelectedPalette = (nSelectedPalette + 1) & 0x07;
+		if (GetKey(olc::Key::M).bPressed) bRecordToggled = true;
+
+		DrawCpu(516, 2, frame.status, frame.pc, frame.a, frame.x, frame.y, frame.stkp);
+		if (frame.bRecording)
+			DrawString(716, 2, "REC", olc::RED);
+		DrawCode(516, 72, 26, frame.pc);
 
 		// Draw AUDIO Channels
 		//DrawAudio(0, 520, 72);
@@ -321,22 +498,23 @@ private:
 		for (int p = 0; p < 8; p++) // For each palette
 			for (int s = 0; s < 4; s++) // For each index
 				FillRect(516 + p * (nSwatchSize * 5) + s * nSwatchSize, 340,
-					nSwatchSize, nSwatchSize, nes.ppu.GetColourFromPaletteRam(p, s));
+					nSwatchSize, nSwatchSize, Colour(nes.ppu.GetColourFromIndex(frame.palette[p * 4 + s])));
 
 		// Draw selection reticule around selected palette
 		DrawRect(516 + nSelectedPalette * (nSwatchSize * 5) - 1, 339, (nSwatchSize * 4), nSwatchSize, olc::WHITE);
 
-		// Generate Pattern Tables
-		DrawSprite(516, 348, &nes.ppu.GetPatternTable(0, nSelectedPalette));
-		DrawSprite(648, 348, &nes.ppu.GetPatternTable(1, nSelectedPalette));
+		// Pattern Tables, as generated by the emulation thread
+		DrawSprite(516, 348, Present(sprPatternTable[0], frame.pattern[0]));
+		DrawSprite(648, 348, Present(sprPatternTable[1], frame.pattern[1]));
 
 		// Draw rendered output ========================================================
-		DrawSprite(0, 0, &nes.ppu.GetScreen(), 2);
+		DrawSprite(0, 0, PresentScreen(frame.screen), 2);
 		return true;
 	}
 
 	// This performs emulation with no audio synchronisation, so it is just
-	// as before, in all the previous videos
+	// as before, in all the previous videos. It drives the NES from the render
+	// thread, so must not be used while the emulation thread is running.
 	bool EmulatorUpdateWithoutAudio(float fElapsedTime)
 	{
 		Clear(olc::DARK_BLUE);
@@ -354,7 +532,7 @@ private:
 
 		if (GetKey(olc::Key::SPACE).bPressed) bEmulationRun = !bEmulationRun;
 		if (GetKey(olc::Key::R).bPressed) nes.reset();
-		if (GetKey(olc::Key::P).bPressed) (++nSelectedPalette) &= 0x07;
+		if (GetKey(olc::Key::P).bPressed) nSelectedPalette = (nSelectedPalette + 1) & 0x07;
 
 		if (bEmulationRun)
 		{
@@ -410,17 +588,17 @@ private:
 		for (int p = 0; p < 8; p++) // For each palette
 			for (int s = 0; s < 4; s++) // For each index
 				FillRect(516 + p * (nSwatchSize * 5) + s * nSwatchSize, 340,
-					nSwatchSize, nSwatchSize, nes.ppu.GetColourFromPaletteRam(p, s));
+					nSwatchSize, nSwatchSize, Colour(nes.ppu.GetColourFromPaletteRam(p, s)));
 
 		// Draw selection reticule around selected palette
 		DrawRect(516 + nSelectedPalette * (nSwatchSize * 5) - 1, 339, (nSwatchSize * 4), nSwatchSize, olc::WHITE);
 
 		// Generate Pattern Tables
-		DrawSprite(516, 348, &nes.ppu.GetPatternTable(0, nSelectedPalette));
-		DrawSprite(648, 348, &nes.ppu.GetPatternTable(1, nSelectedPalette));
+		DrawSprite(516, 348, Present(sprPatternTable[0], nes.ppu.GetPatternTable(0, nSelectedPalette)));
+		DrawSprite(648, 348, Present(sprPatternTable[1], nes.ppu.GetPatternTable(1, nSelectedPalette)));
 
 		// Draw rendered output ========================================================
-		DrawSprite(0, 0, &nes.ppu.GetScreen(), 2);
+		DrawSprite(0, 0, PresentScreen(), 2);
 		return true;
 	}
 };
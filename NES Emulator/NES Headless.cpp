@@ -0,0 +1,448 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+#include "bus.h"
+#include "BatchRunner.h"
+#include "Hash.h"
+#include "InputMovie.h"
+#include "RewindBuffer.h"
+
+// Headless front end for the emulation core. There is no window and no audio
+// device, the NES is simply clocked as fast as the host allows for a fixed
+// number of frames, and the results are written to disk. This is what batch
+// jobs on servers should use rather than the interactive NES_Emulator.
+
+struct HeadlessOptions
+{
+	std::string sRomFile;
+	std::string sFrameDir;	// Directory to write framebuffers into, empty for none
+	std::string sAudioFile;	// 16-bit mono WAV output, empty for none
+	std::string sStateFile;	// CPU registers and RAM at exit, empty for none
+	std::string sLoadState;	// Save state to start from, empty to start from reset
+	std::string sSaveState;	// Save state to write at exit, empty for none
+	std::string sMovieFile;	// Input movie to play back, empty for none
+	std::string sHashFile;	// Hashes of every frame's output and state, empty for none
+	uint32_t nFrames = 600;	// Or the length of the movie, if there is one and this is not given
+	bool bFramesGiven = false;
+	uint32_t nFrameEvery = 0;	// Write every Nth frame, 0 writes only the last one
+	uint32_t nSampleRate = 44100;
+	bool bPerCycle = false;	// Clock every device every cycle rather than catching up
+	uint32_t nBatch = 0;	// Consoles to run alongside in a BatchRunner and check against, 0 for none
+	uint32_t nRewindEvery = 0;	// Frames between rewinds when checking rewind, 0 for no check
+};
+
+class NES_Headless
+{
+public:
+	NES_Headless(const HeadlessOptions& o) : opt(o) {}
+
+	bool Run()
+	{
+		cart = std::make_shared<Cartridge>(opt.sRomFile);
+		if (!cart->ImageValid())
+		{
+			std::cerr << "Could not load ROM: " << opt.sRomFile << "\n";
+			return false;
+		}
+
+		nes.insertCartridge(cart);
+		nes.SetCatchUp(!opt.bPerCycle);
+		if (opt.nSampleRate > 0)
+			nes.SetSampleFrequency(opt.nSampleRate);
+		nes.reset();
+
+		if (!opt.sLoadState.empty() && !LoadState(nes, opt.sLoadState))
+		{
+			std::cerr << "Could not load state: " << opt.sLoadState << "\n";
+			return false;
+		}
+
+		if (!opt.sMovieFile.empty())
+		{
+			if (!movie.Load(opt.sMovieFile))
+			{
+				std::cerr << "Could not load movie: " << opt.sMovieFile << "\n";
+				return false;
+			}
+
+			if (movie.RomHash() != cart->GetImage()->nHash)
+			{
+				std::cerr << "Movie was recorded with a different ROM: " << opt.sMovieFile << "\n";
+				return false;
+			}
+
+			if (!movie.Start(nes))
+			{
+				std::cerr << "Could not load the movie's start state: " << opt.sMovieFile << "\n";
+				return false;
+			}
+
+			if (!opt.bFramesGiven)
+				opt.nFrames = (uint32_t)movie.Frames();
+		}
+
+		if (!opt.sHashFile.empty())
+		{
+			ofsHashes.open(opt.sHashFile);
+			if (!ofsHashes.is_open())
+			{
+				std::cerr << "Could not write hashes: " << opt.sHashFile << "\n";
+				return false;
+			}
+		}
+
+		auto tp1 = std::chrono::steady_clock::now();
+
+		for (uint32_t nFrame = 0; nFrame < opt.nFrames; nFrame++)
+		{
+			// Emulate a single frame, collecting any audio samples
+			// produced along the way. Past the end of a movie, the
+			// controllers are left as they were last set.
+			movie.Apply(nes, nFrame);
+			nes.frame();
+			if (ofsHashes.is_open())
+				WriteHashes(nFrame);
+			if (opt.nBatch > 0)
+				vFrameHashes.push_back(HashBytes(nes.ppu.GetScreenIndices(), 256 * 240));
+			vAudio.insert(vAudio.end(), nes.vAudioSamples.begin(), nes.vAudioSamples.end());
+			nes.vAudioSamples.clear();
+
+			bool bLastFrame = nFrame + 1 == opt.nFrames;
+			if (!opt.sFrameDir.empty() && (bLastFrame || (opt.nFrameEvery > 0 && nFrame % opt.nFrameEvery == 0)))
+				WriteFrame(opt.sFrameDir + "/frame_" + std::to_string(nFrame) + ".ppm");
+		}
+
+		auto tp2 = std::chrono::steady_clock::now();
+		double dElapsed = std::chrono::duration<double>(tp2 - tp1).count();
+
+		if (!opt.sAudioFile.empty()) WriteAudio(opt.sAudioFile);
+		if (!opt.sStateFile.empty()) WriteState(opt.sStateFile);
+		if (!opt.sSaveState.empty()) SaveState(opt.sSaveState);
+
+		std::cout << "frames=" << opt.nFrames
+			<< " seconds=" << dElapsed
+			<< " fps=" << (dElapsed > 0.0 ? opt.nFrames / dElapsed : 0.0)
+			<< " samples=" << vAudio.size() << "\n";
+
+		if (opt.nBatch > 0 && !CheckBatch())
+			return false;
+
+		if (opt.nRewindEvery > 0 && !CheckRewind())
+			return false;
+
+		return true;
+	}
+
+private:
+	HeadlessOptions opt;
+	Bus nes;
+	std::shared_ptr<Cartridge> cart;
+	std::vector<float> vAudio;
+	InputMovie movie;
+	std::ofstream ofsHashes;
+	std::vector<uint64_t> vFrameHashes; // Of the picture, kept to check the batch runner against
+
+	// Runs the same ROM, from the same start and with the same input, on
+	// as many consoles at once in a BatchRunner, and checks every one ends
+	// up with the same pictures, audio and RAM as the console run above
+	bool CheckBatch()
+	{
+		BatchRunner runner;
+		for (uint32_t i = 0; i < opt.nBatch; i++)
+		{
+			if (!runner.Add(cart->GetImage(), opt.nSampleRate, !opt.bPerCycle)
+				|| (!opt.sLoadState.empty() && !LoadState(runner.Console(i), opt.sLoadState))
+				|| (!opt.sMovieFile.empty() && !movie.Start(runner.Console(i))))
+			{
+				std::cerr << "Could not start batch console " << i << "\n";
+				return false;
+			}
+		}
+
+		auto tp1 = std::chrono::steady_clock::now();
+
+		// Input has to be set between frames, otherwise every console
+		// can be left to run all its frames in one go
+		if (opt.sMovieFile.empty())
+		{
+			runner.Run(opt.nFrames);
+		}
+		else
+		{
+			for (uint32_t nFrame = 0; nFrame < opt.nFrames; nFrame++)
+			{
+				for (uint32_t i = 0; i < opt.nBatch; i++)
+					movie.Apply(runner.Console(i), nFrame);
+				runner.Run(1);
+			}
+		}
+
+		auto tp2 = std::chrono::steady_clock::now();
+		double dElapsed = std::chrono::duration<double>(tp2 - tp1).count();
+
+		uint32_t nMismatched = 0;
+		for (uint32_t i = 0; i < opt.nBatch; i++)
+		{
+			const BatchRunner::sOutput& output = runner.Output(i);
+
+			const char* sWhat = nullptr;
+			if (output.vFrameHashes != vFrameHashes) sWhat = "frames";
+			else if (output.vAudio != vAudio) sWhat = "audio";
+			else if (output.ram != nes.cpuRAM) sWhat = "RAM";
+
+			if (sWhat != nullptr)
+			{
+				std::cerr << "Batch console " << i << " differs in " << sWhat << "\n";
+				nMismatched++;
+			}
+		}
+
+		std::cout << "batch=" << opt.nBatch
+			<< " seconds=" << dElapsed
+			<< " fps=" << (dElapsed > 0.0 ? (double)opt.nFrames * opt.nBatch / dElapsed : 0.0)
+			<< " mismatched=" << nMismatched << "\n";
+
+		return nMismatched == 0;
+	}
+
+	// One line per frame: the frame number, then a hash of everything
+	// below together, then of the picture, CPU RAM, CPU registers and the
+	// frame's audio each on their own, so that where two runs first part
+	// ways shows what went wrong as well as when
+	void WriteHashes(uint32_t nFrame)
+	{
+		uint8_t regs[7] = { nes.cpu.accumulator, nes.cpu.x, nes.cpu.y, nes.cpu.stkp,
+			(uint8_t)(nes.cpu.pc & 0x00FF), (uint8_t)(nes.cpu.pc >> 8), nes.cpu.status };
+
+		uint64_t nHashes[4] = {
+			HashBytes(nes.ppu.GetScreenIndices(), 256 * 240),
+			HashBytes(nes.cpuRAM.data(), nes.cpuRAM.size()),
+			HashBytes(regs, sizeof(regs)),
+			HashBytes(nes.vAudioSamples.data(), nes.vAudioSamples.size() * sizeof(float)) };
+
+		ofsHashes << nFrame << std::hex << std::setfill('0')
+			<< " " << std::setw(16) << HashBytes(nHashes, sizeof(nHashes));
+		for (uint64_t h : nHashes)
+			ofsHashes << " " << std::setw(16) << h;
+		ofsHashes << std::dec << "\n";
+	}
+
+	// Runs the same frames again on another console, rewinding it every so
+	// many frames by a varying distance and playing on from there. Every
+	// time a frame is reached the console's state has to be the same as
+	// the first time, and at the end the same as the console run above.
+	bool CheckRewind()
+	{
+		auto console = std::make_unique<Bus>();
+		console->insertCartridge(std::make_shared<Cartridge>(cart->GetImage()));
+		console->SetCatchUp(!opt.bPerCycle);
+		if (opt.nSampleRate > 0)
+			console->SetSampleFrequency(opt.nSampleRate);
+		console->reset();
+
+		if ((!opt.sLoadState.empty() && !LoadState(*console, opt.sLoadState))
+			|| (!opt.sMovieFile.empty() && !movie.Start(*console)))
+		{
+			std::cerr << "Could not start rewind console\n";
+			return false;
+		}
+
+		RewindBuffer rewind;
+		std::vector<uint64_t> vStateHashes;
+		std::vector<uint8_t> vState;
+		uint32_t nRewinds = 0, nMismatched = 0, nRandom = 1;
+		double dRewinding = 0.0;
+
+		uint32_t nNextRewind = opt.nRewindEvery;
+		for (uint32_t nFrame = 0; nFrame < opt.nFrames; nFrame++)
+		{
+			movie.Apply(*console, nFrame);
+			console->frame();
+			console->vAudioSamples.clear();
+			rewind.Push(*console);
+
+			console->saveState(vState, false);
+			uint64_t nHash = HashBytes(vState.data(), vState.size());
+			if (nFrame == vStateHashes.size())
+				vStateHashes.push_back(nHash);
+			else if (vStateHashes[nFrame] != nHash)
+				nMismatched++;
+
+			if (nFrame + 1 == nNextRewind)
+			{
+				// Anywhere from the frame just run to twice the
+				// interval back, as far as the buffer goes
+				nRandom = nRandom * 1103515245 + 12345;
+				uint32_t nBack = (nRandom >> 16) % (2 * opt.nRewindEvery);
+				if (nBack >= rewind.Frames())
+					nBack = (uint32_t)rewind.Frames() - 1;
+
+				auto tp1 = std::chrono::steady_clock::now();
+				bool bRewound = rewind.Rewind(*console, nBack);
+				auto tp2 = std::chrono::steady_clock::now();
+				dRewinding += std::chrono::duration<double>(tp2 - tp1).count();
+
+				if (!bRewound)
+				{
+					std::cerr << "Could not rewind " << nBack << " frames from frame " << nFrame << "\n";
+					return false;
+				}
+
+				nRewinds++;
+				nNextRewind += opt.nRewindEvery;
+				nFrame -= nBack;
+
+				console->saveState(vState, false);
+				if (vStateHashes[nFrame] != HashBytes(vState.data(), vState.size()))
+					nMismatched++;
+			}
+		}
+
+		// Only the picture is left out of a rewind, and it has since been redrawn
+		std::vector<uint8_t> vFinal;
+		nes.saveState(vFinal, false);
+		console->saveState(vState, false);
+		if (vState != vFinal)
+			nMismatched++;
+
+		std::cout << "rewinds=" << nRewinds
+			<< " rewind_us=" << (nRewinds > 0 ? dRewinding / nRewinds * 1e6 : 0.0)
+			<< " bytes=" << rewind.Bytes()
+			<< " mismatched=" << nMismatched << "\n";
+
+		return nMismatched == 0;
+	}
+
+	// Binary PPM, the simplest image format most tools will open
+	void WriteFrame(const std::string& sFile)
+	{
+		olc2C02::Sprite& screen = nes.ppu.GetScreen();
+		std::ofstream ofs(sFile, std::ofstream::binary);
+		ofs << "P6\n" << screen.width << " " << screen.height << "\n255\n";
+		for (const auto& p : screen.pColData)
+		{
+			ofs.put((char)p.r);
+			ofs.put((char)p.g);
+			ofs.put((char)p.b);
+		}
+	}
+
+	void WriteAudio(const std::string& sFile)
+	{
+		auto put16 = [](std::ofstream& o, uint16_t v) { o.put((char)(v & 0xFF)); o.put((char)(v >> 8)); };
+		auto put32 = [](std::ofstream& o, uint32_t v) { for (int i = 0; i < 4; i++) o.put((char)((v >> (i * 8)) & 0xFF)); };
+
+		uint32_t nDataSize = (uint32_t)vAudio.size() * sizeof(int16_t);
+
+		std::ofstream ofs(sFile, std::ofstream::binary);
+		ofs.write("RIFF", 4); put32(ofs, 36 + nDataSize); ofs.write("WAVE", 4);
+		ofs.write("fmt ", 4); put32(ofs, 16);
+		put16(ofs, 1);					// PCM
+		put16(ofs, 1);					// Mono
+		put32(ofs, opt.nSampleRate);
+		put32(ofs, opt.nSampleRate * sizeof(int16_t));
+		put16(ofs, sizeof(int16_t));
+		put16(ofs, 16);
+		ofs.write("data", 4); put32(ofs, nDataSize);
+
+		for (float s : vAudio)
+		{
+			if (s > 1.0f) s = 1.0f;
+			if (s < -1.0f) s = -1.0f;
+			put16(ofs, (uint16_t)(int16_t)(s * 32767.0f));
+		}
+	}
+
+	// CPU registers followed by the 2KB of internal RAM
+	void WriteState(const std::string& sFile)
+	{
+		std::ofstream ofs(sFile, std::ofstream::binary);
+		uint8_t regs[7] = { nes.cpu.accumulator, nes.cpu.x, nes.cpu.y, nes.cpu.stkp,
+			(uint8_t)(nes.cpu.pc & 0x00FF), (uint8_t)(nes.cpu.pc >> 8), nes.cpu.status };
+		ofs.write((const char*)regs, sizeof(regs));
+		ofs.write((const char*)nes.cpuRAM.data(), nes.cpuRAM.size());
+	}
+
+	void SaveState(const std::string& sFile)
+	{
+		std::vector<uint8_t> vState;
+		nes.saveState(vState);
+		std::ofstream ofs(sFile, std::ofstream::binary);
+		ofs.write((const char*)vState.data(), vState.size());
+	}
+
+	bool LoadState(Bus& console, const std::string& sFile)
+	{
+		std::ifstream ifs(sFile, std::ifstream::binary);
+		std::vector<uint8_t> vState((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		return console.loadState(vState);
+	}
+};
+
+static void Usage()
+{
+	std::cerr <<
+		"Usage: \"NES Headless\" <rom.nes> [options]\n"
+		"  -frames N        Number of frames to emulate (default 600)\n"
+		"  -rate N          Audio sample rate, 0 disables audio (default 44100)\n"
+		"  -frame-dir DIR   Write framebuffers as PPM images into DIR\n"
+		"  -frame-every N   Write every Nth frame instead of only the last\n"
+		"  -audio FILE      Write audio as a 16-bit mono WAV file\n"
+		"  -state FILE      Write CPU registers and RAM on exit\n"
+		"  -load-state FILE Start from a save state rather than from reset\n"
+		"  -save-state FILE Write a save state on exit\n"
+		"  -movie FILE      Play back an input movie, for its length unless -frames is given\n"
+		"  -hashes FILE     Write hashes of the picture, RAM, CPU and audio every frame\n"
+		"  -cycle           Clock every device every cycle instead of catching up\n"
+		"  -batch N         Also run N consoles at once in a batch runner, failing\n"
+		"                   unless every one matches the pictures, audio and RAM\n"
+		"  -rewind N        Also replay the run rewinding every N frames, failing\n"
+		"                   unless every frame comes back the same\n";
+}
+
+int main(int argc, char* argv[])
+{
+	HeadlessOptions opt;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool bHasValue = i + 1 < argc;
+
+		if (arg == "-frames" && bHasValue) { opt.nFrames = std::strtoul(argv[++i], nullptr, 10); opt.bFramesGiven = true; }
+		else if (arg == "-rate" && bHasValue) opt.nSampleRate = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-frame-dir" && bHasValue) opt.sFrameDir = argv[++i];
+		else if (arg == "-frame-every" && bHasValue) opt.nFrameEvery = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-audio" && bHasValue) opt.sAudioFile = argv[++i];
+		else if (arg == "-state" && bHasValue) opt.sStateFile = argv[++i];
+		else if (arg == "-load-state" && bHasValue) opt.sLoadState = argv[++i];
+		else if (arg == "-save-state" && bHasValue) opt.sSaveState = argv[++i];
+		else if (arg == "-movie" && bHasValue) opt.sMovieFile = argv[++i];
+		else if (arg == "-hashes" && bHasValue) opt.sHashFile = argv[++i];
+		else if (arg == "-cycle") opt.bPerCycle = true;
+		else if (arg == "-batch" && bHasValue) opt.nBatch = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-rewind" && bHasValue) opt.nRewindEvery = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg[0] != '-' && opt.sRomFile.empty()) opt.sRomFile = arg;
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (opt.sRomFile.empty())
+	{
+		Usage();
+		return 1;
+	}
+
+	NES_Headless headless(opt);
+	return headless.Run() ? 0 : 1;
+}
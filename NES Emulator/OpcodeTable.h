@@ -0,0 +1,24 @@
+#pragma once
+
+// The 6502's instruction set, one entry per opcode in order: the operation,
+// the addressing mode, the base cycle count and the name the disassembler
+// shows, which is "???" for the unofficial opcodes. Every CPU and table that
+// needs to know what an opcode does expands this list, with X defined to
+// make whatever entry it needs of those four, so they can never disagree.
+#define OPCODE_TABLE_6502(X) \
+	/* 0x00 */ X(BRK, IMM, 7, "BRK") X(ORA, IZX, 6, "ORA") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 3, "???") X(ORA, ZP0, 3, "ORA") X(ASL, ZP0, 5, "ASL") X(XXX, IMP, 5, "???") X(PHP, IMP, 3, "PHP") X(ORA, IMM, 2, "ORA") X(ASL, IMP, 2, "ASL") X(XXX, IMP, 2, "???") X(NOP, IMP, 4, "???") X(ORA, ABS, 4, "ORA") X(ASL, ABS, 6, "ASL") X(XXX, IMP, 6, "???") \
+	/* 0x10 */ X(BPL, REL, 2, "BPL") X(ORA, IZY, 5, "ORA") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 4, "???") X(ORA, ZPX, 4, "ORA") X(ASL, ZPX, 6, "ASL") X(XXX, IMP, 6, "???") X(CLC, IMP, 2, "CLC") X(ORA, ABY, 4, "ORA") X(NOP, IMP, 2, "???") X(XXX, IMP, 7, "???") X(NOP, IMP, 4, "???") X(ORA, ABX, 4, "ORA") X(ASL, ABX, 7, "ASL") X(XXX, IMP, 7, "???") \
+	/* 0x20 */ X(JSR, ABS, 6, "JSR") X(AND, IZX, 6, "AND") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(BIT, ZP0, 3, "BIT") X(AND, ZP0, 3, "AND") X(ROL, ZP0, 5, "ROL") X(XXX, IMP, 5, "???") X(PLP, IMP, 4, "PLP") X(AND, IMM, 2, "AND") X(ROL, IMP, 2, "ROL") X(XXX, IMP, 2, "???") X(BIT, ABS, 4, "BIT") X(AND, ABS, 4, "AND") X(ROL, ABS, 6, "ROL") X(XXX, IMP, 6, "???") \
+	/* 0x30 */ X(BMI, REL, 2, "BMI") X(AND, IZY, 5, "AND") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 4, "???") X(AND, ZPX, 4, "AND") X(ROL, ZPX, 6, "ROL") X(XXX, IMP, 6, "???") X(SEC, IMP, 2, "SEC") X(AND, ABY, 4, "AND") X(NOP, IMP, 2, "???") X(XXX, IMP, 7, "???") X(NOP, IMP, 4, "???") X(AND, ABX, 4, "AND") X(ROL, ABX, 7, "ROL") X(XXX, IMP, 7, "???") \
+	/* 0x40 */ X(RTI, IMP, 6, "RTI") X(EOR, IZX, 6, "EOR") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 3, "???") X(EOR, ZP0, 3, "EOR") X(LSR, ZP0, 5, "LSR") X(XXX, IMP, 5, "???") X(PHA, IMP, 3, "PHA") X(EOR, IMM, 2, "EOR") X(LSR, IMP, 2, "LSR") X(XXX, IMP, 2, "???") X(JMP, ABS, 3, "JMP") X(EOR, ABS, 4, "EOR") X(LSR, ABS, 6, "LSR") X(XXX, IMP, 6, "???") \
+	/* 0x50 */ X(BVC, REL, 2, "BVC") X(EOR, IZY, 5, "EOR") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 4, "???") X(EOR, ZPX, 4, "EOR") X(LSR, ZPX, 6, "LSR") X(XXX, IMP, 6, "???") X(CLI, IMP, 2, "CLI") X(EOR, ABY, 4, "EOR") X(NOP, IMP, 2, "???") X(XXX, IMP, 7, "???") X(NOP, IMP, 4, "???") X(EOR, ABX, 4, "EOR") X(LSR, ABX, 7, "LSR") X(XXX, IMP, 7, "???") \
+	/* 0x60 */ X(RTS, IMP, 6, "RTS") X(ADC, IZX, 6, "ADC") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 3, "???") X(ADC, ZP0, 3, "ADC") X(ROR, ZP0, 5, "ROR") X(XXX, IMP, 5, "???") X(PLA, IMP, 4, "PLA") X(ADC, IMM, 2, "ADC") X(ROR, IMP, 2, "ROR") X(XXX, IMP, 2, "???") X(JMP, IND, 5, "JMP") X(ADC, ABS, 4, "ADC") X(ROR, ABS, 6, "ROR") X(XXX, IMP, 6, "???") \
+	/* 0x70 */ X(BVS, REL, 2, "BVS") X(ADC, IZY, 5, "ADC") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 4, "???") X(ADC, ZPX, 4, "ADC") X(ROR, ZPX, 6, "ROR") X(XXX, IMP, 6, "???") X(SEI, IMP, 2, "SEI") X(ADC, ABY, 4, "ADC") X(NOP, IMP, 2, "???") X(XXX, IMP, 7, "???") X(NOP, IMP, 4, "???") X(ADC, ABX, 4, "ADC") X(ROR, ABX, 7, "ROR") X(XXX, IMP, 7, "???") \
+	/* 0x80 */ X(NOP, IMP, 2, "???") X(STA, IZX, 6, "STA") X(NOP, IMP, 2, "???") X(XXX, IMP, 6, "???") X(STY, ZP0, 3, "STY") X(STA, ZP0, 3, "STA") X(STX, ZP0, 3, "STX") X(XXX, IMP, 3, "???") X(DEY, IMP, 2, "DEY") X(NOP, IMP, 2, "???") X(TXA, IMP, 2, "TXA") X(XXX, IMP, 2, "???") X(STY, ABS, 4, "STY") X(STA, ABS, 4, "STA") X(STX, ABS, 4, "STX") X(XXX, IMP, 4, "???") \
+	/* 0x90 */ X(BCC, REL, 2, "BCC") X(STA, IZY, 6, "STA") X(XXX, IMP, 2, "???") X(XXX, IMP, 6, "???") X(STY, ZPX, 4, "STY") X(STA, ZPX, 4, "STA") X(STX, ZPY, 4, "STX") X(XXX, IMP, 4, "???") X(TYA, IMP, 2, "TYA") X(STA, ABY, 5, "STA") X(TXS, IMP, 2, "TXS") X(XXX, IMP, 5, "???") X(NOP, IMP, 5, "???") X(STA, ABX, 5, "STA") X(XXX, IMP, 5, "???") X(XXX, IMP, 5, "???") \
+	/* 0xA0 */ X(LDY, IMM, 2, "LDY") X(LDA, IZX, 6, "LDA") X(LDX, IMM, 2, "LDX") X(XXX, IMP, 6, "???") X(LDY, ZP0, 3, "LDY") X(LDA, ZP0, 3, "LDA") X(LDX, ZP0, 3, "LDX") X(XXX, IMP, 3, "???") X(TAY, IMP, 2, "TAY") X(LDA, IMM, 2, "LDA") X(TAX, IMP, 2, "TAX") X(XXX, IMP, 2, "???") X(LDY, ABS, 4, "LDY") X(LDA, ABS, 4, "LDA") X(LDX, ABS, 4, "LDX") X(XXX, IMP, 4, "???") \
+	/* 0xB0 */ X(BCS, REL, 2, "BCS") X(LDA, IZY, 5, "LDA") X(XXX, IMP, 2, "???") X(XXX, IMP, 5, "???") X(LDY, ZPX, 4, "LDY") X(LDA, ZPX, 4, "LDA") X(LDX, ZPY, 4, "LDX") X(XXX, IMP, 4, "???") X(CLV, IMP, 2, "CLV") X(LDA, ABY, 4, "LDA") X(TSX, IMP, 2, "TSX") X(XXX, IMP, 4, "???") X(LDY, ABX, 4, "LDY") X(LDA, ABX, 4, "LDA") X(LDX, ABY, 4, "LDX") X(XXX, IMP, 4, "???") \
+	/* 0xC0 */ X(CPY, IMM, 2, "CPY") X(CMP, IZX, 6, "CMP") X(NOP, IMP, 2, "???") X(XXX, IMP, 8, "???") X(CPY, ZP0, 3, "CPY") X(CMP, ZP0, 3, "CMP") X(DEC, ZP0, 5, "DEC") X(XXX, IMP, 5, "???") X(INY, IMP, 2, "INY") X(CMP, IMM, 2, "CMP") X(DEX, IMP, 2, "DEX") X(XXX, IMP, 2, "???") X(CPY, ABS, 4, "CPY") X(CMP, ABS, 4, "CMP") X(DEC, ABS, 6, "DEC") X(XXX, IMP, 6, "???") \
+	/* 0xD0 */ X(BNE, REL, 2, "BNE") X(CMP, IZY, 5, "CMP") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 4, "???") X(CMP, ZPX, 4, "CMP") X(DEC, ZPX, 6, "DEC") X(XXX, IMP, 6, "???") X(CLD, IMP, 2, "CLD") X(CMP, ABY, 4, "CMP") X(NOP, IMP, 2, "NOP") X(XXX, IMP, 7, "???") X(NOP, IMP, 4, "???") X(CMP, ABX, 4, "CMP") X(DEC, ABX, 7, "DEC") X(XXX, IMP, 7, "???") \
+	/* 0xE0 */ X(CPX, IMM, 2, "CPX") X(SBC, IZX, 6, "SBC") X(NOP, IMP, 2, "???") X(XXX, IMP, 8, "???") X(CPX, ZP0, 3, "CPX") X(SBC, ZP0, 3, "SBC") X(INC, ZP0, 5, "INC") X(XXX, IMP, 5, "???") X(INX, IMP, 2, "INX") X(SBC, IMM, 2, "SBC") X(NOP, IMP, 2, "NOP") X(SBC, IMP, 2, "???") X(CPX, ABS, 4, "CPX") X(SBC, ABS, 4, "SBC") X(INC, ABS, 6, "INC") X(XXX, IMP, 6, "???") \
+	/* 0xF0 */ X(BEQ, REL, 2, "BEQ") X(SBC, IZY, 5, "SBC") X(XXX, IMP, 2, "???") X(XXX, IMP, 8, "???") X(NOP, IMP, 4, "???") X(SBC, ZPX, 4, "SBC") X(INC, ZPX, 6, "INC") X(XXX, IMP, 6, "???") X(SED, IMP, 2, "SED") X(SBC, ABY, 4, "SBC") X(NOP, IMP, 2, "NOP") X(XXX, IMP, 7, "???") X(NOP, IMP, 4, "???") X(SBC, ABX, 4, "SBC") X(INC, ABX, 7, "INC") X(XXX, IMP, 7, "???")
@@ -0,0 +1,217 @@
+#include "RewindBuffer.h"
+
+#include <cstring>
+
+RewindBuffer::RewindBuffer(size_t nMaxBytes, uint32_t nKeyframeInterval)
+	: nMaxBytes(nMaxBytes), nKeyframeInterval(nKeyframeInterval > 0 ? nKeyframeInterval : 1)
+{
+}
+
+void RewindBuffer::Push(Bus& nes)
+{
+	// The picture is most of a state, and most of what changes from one
+	// frame to the next, but it is redrawn by the next frame anyway
+	nes.saveState(vCapture, false);
+
+	sSnapshot snapshot;
+	snapshot.bKeyframe = snapshots.empty() || nSinceKeyframe >= nKeyframeInterval || vCapture.size() != vLatest.size();
+	Encode(vCapture, snapshot.bKeyframe ? nullptr : &vLatest, vEncoded);
+	snapshot.vData.assign(vEncoded.begin(), vEncoded.end());
+
+	nBytes += snapshot.vData.size();
+	nKeyframes += snapshot.bKeyframe ? 1 : 0;
+	nSinceKeyframe = snapshot.bKeyframe ? 1 : nSinceKeyframe + 1;
+	snapshots.push_back(std::move(snapshot));
+	vLatest.swap(vCapture);
+
+	// Always keep at least the most recent keyframe
+	while (nBytes > nMaxBytes && nKeyframes > 1)
+		DropOldest();
+}
+
+bool RewindBuffer::Rewind(Bus& nes, uint32_t nFrames)
+{
+	if (nFrames >= snapshots.size())
+		return false;
+
+	size_t nTarget = snapshots.size() - 1 - nFrames;
+
+	// Nearest keyframe at or before the target, and whether there is
+	// one between it and the most recent state
+	size_t nKey = nTarget;
+	while (!snapshots[nKey].bKeyframe)
+		nKey--;
+
+	bool bKeyAfter = false;
+	for (size_t i = nTarget + 1; i < snapshots.size() && !bKeyAfter; i++)
+		bKeyAfter = snapshots[i].bKeyframe;
+
+	// The state is rebuilt to one side, and nothing is forgotten until
+	// the console has taken it, so a failure changes neither
+	bool bRebuilt = true;
+	if (!bKeyAfter && nFrames <= nTarget - nKey)
+	{
+		// Undo the most recent deltas
+		vCapture.assign(vLatest.begin(), vLatest.end());
+		for (size_t i = snapshots.size() - 1; i > nTarget && bRebuilt; i--)
+			bRebuilt = Apply(snapshots[i].vData, vCapture, false);
+	}
+	else
+	{
+		// Rebuild from the keyframe
+		bRebuilt = Apply(snapshots[nKey].vData, vCapture, true);
+		for (size_t i = nKey + 1; i <= nTarget && bRebuilt; i++)
+			bRebuilt = Apply(snapshots[i].vData, vCapture, false);
+	}
+
+	if (!bRebuilt || !nes.loadState(vCapture))
+		return false;
+
+	vLatest.swap(vCapture);
+
+	while (snapshots.size() > nTarget + 1)
+	{
+		nBytes -= snapshots.back().vData.size();
+		nKeyframes -= snapshots.back().bKeyframe ? 1 : 0;
+		snapshots.pop_back();
+	}
+
+	nSinceKeyframe = (uint32_t)(nTarget - nKey + 1);
+
+	return true;
+}
+
+void RewindBuffer::Clear()
+{
+	snapshots.clear();
+	vLatest.clear();
+	nBytes = 0;
+	nSinceKeyframe = 0;
+	nKeyframes = 0;
+}
+
+void RewindBuffer::DropOldest()
+{
+	do
+	{
+		nBytes -= snapshots.front().vData.size();
+		nKeyframes -= snapshots.front().bKeyframe ? 1 : 0;
+		snapshots.pop_front();
+	} while (!snapshots.empty() && !snapshots.front().bKeyframe);
+}
+
+// The encoding is a series of runs, each a count of unchanged bytes to skip
+// followed by a count of bytes to XOR in and those bytes. Counts are stored
+// 7 bits at a time, as most are small. A run of changes is only broken by
+// at least 4 unchanged bytes, as anything shorter costs more to skip.
+static void PutCount(std::vector<uint8_t>& vOut, size_t n)
+{
+	while (n >= 0x80)
+	{
+		vOut.push_back((uint8_t)(n & 0x7F) | 0x80);
+		n >>= 7;
+	}
+	vOut.push_back((uint8_t)n);
+}
+
+static bool GetCount(const uint8_t*& p, const uint8_t* pEnd, size_t& n)
+{
+	n = 0;
+	for (int nShift = 0; p < pEnd && nShift < 64; nShift += 7)
+	{
+		uint8_t b = *p++;
+		n |= (size_t)(b & 0x7F) << nShift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void RewindBuffer::Encode(const std::vector<uint8_t>& vState, const std::vector<uint8_t>* pBase, std::vector<uint8_t>& vOut)
+{
+	const size_t nSize = vState.size();
+	const uint8_t* pState = vState.data();
+	const uint8_t* pOld = pBase ? pBase->data() : nullptr;
+	auto Diff = [&](size_t i) { return (uint8_t)(pState[i] ^ (pOld ? pOld[i] : 0x00)); };
+
+	vOut.clear();
+	PutCount(vOut, nSize);
+
+	size_t i = 0;
+	while (i < nSize)
+	{
+		// Skip unchanged bytes, 8 at a time where possible
+		size_t nStart = i;
+		while (i + 8 <= nSize)
+		{
+			uint64_t a, b = 0;
+			std::memcpy(&a, pState + i, 8);
+			if (pOld) std::memcpy(&b, pOld + i, 8);
+			if (a != b) break;
+			i += 8;
+		}
+		while (i < nSize && Diff(i) == 0x00)
+			i++;
+
+		size_t nSkip = i - nStart;
+		if (i == nSize)
+		{
+			PutCount(vOut, nSkip);
+			PutCount(vOut, 0);
+			break;
+		}
+
+		// Then changes, until 4 unchanged bytes in a row
+		size_t nChangeStart = i;
+		size_t nSame = 0;
+		while (i < nSize && nSame < 4)
+		{
+			nSame = (Diff(i) == 0x00) ? nSame + 1 : 0;
+			i++;
+		}
+		size_t nChangeEnd = i - nSame;
+		i = nChangeEnd;
+
+		PutCount(vOut, nSkip);
+		PutCount(vOut, nChangeEnd - nChangeStart);
+		for (size_t j = nChangeStart; j < nChangeEnd; j++)
+			vOut.push_back(Diff(j));
+	}
+}
+
+// XOR a snapshot into a state. A keyframe is XORed into zeros, giving
+// the state it holds, however big the state was before.
+bool RewindBuffer::Apply(const std::vector<uint8_t>& vData, std::vector<uint8_t>& vState, bool bKeyframe)
+{
+	const uint8_t* p = vData.data();
+	const uint8_t* pEnd = p + vData.size();
+
+	size_t nSize = 0;
+	if (!GetCount(p, pEnd, nSize))
+		return false;
+
+	if (bKeyframe)
+		vState.assign(nSize, 0x00);
+	else if (nSize != vState.size())
+		return false;
+
+	size_t i = 0;
+	while (p < pEnd)
+	{
+		size_t nSkip = 0, nChanged = 0;
+		if (!GetCount(p, pEnd, nSkip) || !GetCount(p, pEnd, nChanged))
+			return false;
+
+		i += nSkip;
+		if (nSkip > nSize || i > nSize || nChanged > nSize - i || nChanged > (size_t)(pEnd - p))
+			return false;
+
+		for (size_t j = 0; j < nChanged; j++)
+			vState[i + j] ^= p[j];
+
+		p += nChanged;
+		i += nChanged;
+	}
+
+	return true;
+}
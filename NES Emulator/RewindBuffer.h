@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "bus.h"
+
+// Rewind
+// Keeps the console's state as it was at the end of each of a long run of
+// recent frames, so that it can be put back to any of them. Consecutive
+// states barely differ, so rather than a whole save state per frame, each is
+// stored as the XOR of it and the state before, with the runs of zeros that
+// leaves squeezed out. Every so often a keyframe is stored in full instead,
+// so no state is ever more than one keyframe interval's worth of deltas away
+// from one it can be rebuilt from. XOR works both ways, so stepping back from
+// the most recent state is as cheap as stepping forward from a keyframe.
+// Once over its memory budget, the oldest keyframe and its deltas are dropped.
+// The picture is not kept, so after rewinding the screen shows what it did
+// until the next frame is drawn.
+class RewindBuffer
+{
+public:
+	RewindBuffer(size_t nMaxBytes = 64 * 1024 * 1024, uint32_t nKeyframeInterval = 120);
+
+	// Capture the console's state, normally once a frame
+	void Push(Bus& nes);
+
+	// Put the console back as it was nFrames captures before the most
+	// recent, forgetting everything captured since. False, leaving both
+	// the console and the buffer as they were, if there are not that many
+	// or the console will not take the state.
+	bool Rewind(Bus& nes, uint32_t nFrames = 1);
+
+	void Clear();
+	size_t Frames() const { return snapshots.size(); }
+	size_t Bytes() const { return nBytes; }
+
+private:
+	struct sSnapshot
+	{
+		bool bKeyframe = false;
+		std::vector<uint8_t> vData; // Encoded XOR of the state with the one before, or with zeros for a keyframe
+	};
+
+	std::deque<sSnapshot> snapshots;
+	std::vector<uint8_t> vLatest; // The most recent state in full
+	std::vector<uint8_t> vCapture; // Scratch, for the state being pushed or rewound to
+	std::vector<uint8_t> vEncoded;
+
+	size_t nMaxBytes = 0;
+	size_t nBytes = 0;
+	uint32_t nKeyframeInterval = 0;
+	uint32_t nSinceKeyframe = 0;
+	uint32_t nKeyframes = 0;
+
+	static void Encode(const std::vector<uint8_t>& vState, const std::vector<uint8_t>* pBase, std::vector<uint8_t>& vOut);
+	static bool Apply(const std::vector<uint8_t>& vData, std::vector<uint8_t>& vState, bool bKeyframe);
+	void DropOldest();
+};
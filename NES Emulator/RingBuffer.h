@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// A fixed size queue between exactly one producer thread and exactly one
+// consumer thread, e.g. audio samples from the emulation to the sound
+// device. Neither side takes a lock. Each only writes its own index, and
+// reads the other's to find out how much it may push or pop. N must be a
+// power of 2.
+template <typename T, size_t N>
+class RingBuffer
+{
+	static_assert((N & (N - 1)) == 0, "RingBuffer size must be a power of 2");
+
+public:
+	// Producer side, false if the buffer is full
+	bool Push(const T& v)
+	{
+		size_t nHead = head.load(std::memory_order_relaxed);
+		if (nHead - tail.load(std::memory_order_acquire) == N)
+			return false;
+
+		buffer[nHead & (N - 1)] = v;
+		head.store(nHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, false if the buffer is empty
+	bool Pop(T& v)
+	{
+		size_t nTail = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == nTail)
+			return false;
+
+		v = buffer[nTail & (N - 1)];
+		tail.store(nTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Either side, though only exact from the producer's point of view
+	// if the consumer is idle, and vice versa
+	size_t Size() const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+private:
+	// Kept on separate cache lines so the two sides do not contend
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+	T buffer[N];
+};
@@ -0,0 +1,219 @@
+#include "RomCache.h"
+#include "Cartridge.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+namespace
+{
+	struct sPathEntry
+	{
+		uintmax_t nFileSize = 0;
+		std::filesystem::file_time_type tModified;
+		uint64_t nHash = 0;
+	};
+
+	struct sCache
+	{
+		std::mutex mux;
+		std::map<uint64_t, std::shared_ptr<const RomImage>> images;
+		std::map<std::string, sPathEntry> paths;
+	};
+
+	sCache& Cache()
+	{
+		static sCache cache;
+		return cache;
+	}
+
+	std::shared_ptr<const RomImage> Parse(const std::shared_ptr<const MappedFile>& pFile, uint64_t nHash)
+	{
+		// iNES Format Header
+		struct sHeader
+		{
+			char name[4];
+			uint8_t prg_rom_chunks;
+			uint8_t chr_rom_chunks;
+			uint8_t mapper1;
+			uint8_t mapper2;
+			uint8_t prg_ram_size;
+			uint8_t tv_system1;
+			uint8_t tv_system2;
+			char unused[5];
+		} header;
+
+		if (pFile->Size() < sizeof(sHeader))
+			return nullptr;
+
+		std::memcpy(&header, pFile->Data(), sizeof(sHeader));
+		if (std::memcmp(header.name, "NES\x1A", 4) != 0)
+			return nullptr;
+
+		auto pImage = std::make_shared<RomImage>();
+		pImage->nHash = nHash;
+		pImage->pFile = pFile;
+
+		size_t nOffset = sizeof(sHeader);
+
+		// Skip Training Data
+		if (header.mapper1 & 0x04)
+		{
+			nOffset += 512;
+		}
+
+		// Determine Mapper ID
+		pImage->nMapperID = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
+		if (!Cartridge::SupportsMapper(pImage->nMapperID))
+			return nullptr;
+		if (header.mapper1 & 0x08)
+			pImage->hw_mirror = FOURSCREEN;
+		else
+			pImage->hw_mirror = (header.mapper1 & 0x01) ? VERTICAL : HORIZONTAL;
+
+		// Discover file format
+		pImage->bNES2 = (header.mapper2 & 0x0C) == 0x08;
+
+		uint32_t nPRGBanks = header.prg_rom_chunks;
+		uint32_t nCHRBanks = header.chr_rom_chunks;
+
+		if (pImage->bNES2)
+		{
+			nPRGBanks |= (header.prg_ram_size & 0x0F) << 8;
+			nCHRBanks |= (header.prg_ram_size & 0xF0) << 4;
+		}
+
+		// Mappers count banks in a byte. Nothing they support is bigger.
+		if (nPRGBanks == 0 || nPRGBanks > 0xFF || nCHRBanks > 0xFF)
+			return nullptr;
+
+		pImage->nPRGBanks = (uint8_t)nPRGBanks;
+		pImage->nCHRBanks = (uint8_t)nCHRBanks;
+		pImage->nPRGSize = (size_t)nPRGBanks * 16384;
+		pImage->nCHRSize = (size_t)nCHRBanks * 8192;
+
+		if (nOffset + pImage->nPRGSize + pImage->nCHRSize <= pFile->Size())
+		{
+			pImage->pPRGMemory = pFile->Data() + nOffset;
+			pImage->pCHRMemory = pFile->Data() + nOffset + pImage->nPRGSize;
+		}
+		else
+		{
+			// The file is shorter than its header claims, so it can not be
+			// used in place. Take a copy, with whatever is missing as zeros.
+			pImage->vROMCopy.assign(pImage->nPRGSize + pImage->nCHRSize, 0x00);
+			if (pFile->Size() > nOffset)
+				std::memcpy(pImage->vROMCopy.data(), pFile->Data() + nOffset, std::min(pImage->vROMCopy.size(), pFile->Size() - nOffset));
+			pImage->pPRGMemory = pImage->vROMCopy.data();
+			pImage->pCHRMemory = pImage->vROMCopy.data() + pImage->nPRGSize;
+		}
+
+		// Decoded now, while nothing else can see the image, so every
+		// cartridge can read it without locking
+		if (pImage->nCHRSize > 0)
+		{
+			pImage->tiles.Connect(pImage->pCHRMemory, pImage->nCHRSize);
+			pImage->tiles.DecodeAll();
+		}
+
+		return pImage;
+	}
+
+	bool SameContents(const RomImage& image, const MappedFile& file)
+	{
+		return image.pFile->Size() == file.Size()
+			&& std::memcmp(image.pFile->Data(), file.Data(), file.Size()) == 0;
+	}
+}
+
+std::shared_ptr<const RomImage> RomCache::Load(const std::string& sFileName)
+{
+	sCache& cache = Cache();
+
+	std::error_code ec;
+	sPathEntry entry;
+	entry.nFileSize = std::filesystem::file_size(sFileName, ec);
+	if (!ec)
+		entry.tModified = std::filesystem::last_write_time(sFileName, ec);
+	if (ec)
+		return nullptr;
+
+	// Loaded from here before, and the file has not changed since
+	{
+		std::lock_guard<std::mutex> lock(cache.mux);
+
+		auto itPath = cache.paths.find(sFileName);
+		if (itPath != cache.paths.end()
+			&& itPath->second.nFileSize == entry.nFileSize
+			&& itPath->second.tModified == entry.tModified)
+		{
+			auto itImage = cache.images.find(itPath->second.nHash);
+			if (itImage != cache.images.end())
+				return itImage->second;
+		}
+	}
+
+	// Mapping, hashing and parsing a ROM is the slow part, and is done
+	// without holding the cache, so loading one ROM does not hold up
+	// another thread loading a ROM that is already there
+	auto pFile = MappedFile::Open(sFileName);
+	if (pFile == nullptr)
+		return nullptr;
+
+	entry.nHash = HashBytes(pFile->Data(), pFile->Size());
+
+	// The same contents may already be loaded, from another path. A hash
+	// is not the contents though, so it is only the same ROM if the bytes
+	// are the same.
+	std::shared_ptr<const RomImage> pImage = Find(entry.nHash);
+	if (pImage == nullptr || !SameContents(*pImage, *pFile))
+		pImage = Parse(pFile, entry.nHash);
+
+	if (pImage == nullptr)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(cache.mux);
+
+	// Another thread may have loaded the same contents in the meantime, in
+	// which case everyone shares the first image. A different ROM that
+	// happens to have the same hash is returned, but not cached.
+	auto itImage = cache.images.emplace(entry.nHash, pImage).first;
+	if (itImage->second != pImage)
+	{
+		if (!SameContents(*itImage->second, *pFile))
+			return pImage;
+		pImage = itImage->second;
+	}
+
+	cache.paths[sFileName] = entry;
+	return pImage;
+}
+
+std::shared_ptr<const RomImage> RomCache::Find(uint64_t nHash)
+{
+	sCache& cache = Cache();
+	std::lock_guard<std::mutex> lock(cache.mux);
+
+	auto it = cache.images.find(nHash);
+	return it != cache.images.end() ? it->second : nullptr;
+}
+
+void RomCache::Clear()
+{
+	sCache& cache = Cache();
+	std::lock_guard<std::mutex> lock(cache.mux);
+
+	cache.images.clear();
+	cache.paths.clear();
+}
+
+size_t RomCache::Size()
+{
+	sCache& cache = Cache();
+	std::lock_guard<std::mutex> lock(cache.mux);
+
+	return cache.images.size();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Mapper.h"
+#include "TileCache.h"
+
+// A ROM file, parsed. Never changes once loaded, so one image can be shared
+// by any number of cartridges, on any number of threads.
+struct RomImage
+{
+	uint64_t nHash = 0;			// Of the whole file's contents
+	uint8_t nMapperID = 0;
+	uint8_t nPRGBanks = 0;		// 16KB each
+	uint8_t nCHRBanks = 0;		// 8KB each, none if the cartridge has CHR RAM
+	MIRROR hw_mirror = HORIZONTAL;
+	bool bNES2 = false;
+
+	// PRG and CHR ROM, where they are in the mapped file
+	const uint8_t* pPRGMemory = nullptr;
+	const uint8_t* pCHRMemory = nullptr;
+	size_t nPRGSize = 0;
+	size_t nCHRSize = 0;
+
+	// CHR ROM decoded for the renderers, if there is any
+	TileCache tiles;
+
+	std::shared_ptr<const MappedFile> pFile;
+	std::vector<uint8_t> vROMCopy; // Only used if the file is too short to be used in place
+};
+
+// ROM Cache
+// Every ROM loaded in the process, by the hash of its contents, so that a
+// ROM is only read, hashed and parsed the first time it is loaded. After
+// that, loading it again by the same path only needs to check the file has
+// not changed since, and the same ROM under another path is recognised by
+// its contents and shares the one image.
+class RomCache
+{
+public:
+	// The image of a ROM file, or nullptr if it can not be read or is not
+	// an iNES or NES 2.0 file this emulator can run
+	static std::shared_ptr<const RomImage> Load(const std::string& sFileName);
+
+	// The image of an already loaded ROM with these contents, if there is one
+	static std::shared_ptr<const RomImage> Find(uint64_t nHash);
+
+	// Forget every ROM. Images still in use stay valid.
+	static void Clear();
+	static size_t Size();
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Save States
+// Every component writes its state into, and reads it back out of, one flat
+// buffer of bytes, in a fixed order. Values are copied exactly as they are
+// held in memory, so a state is only meant to be loaded by a build of the same
+// version on the same kind of machine, but there is nothing to encode or parse
+// and taking a snapshot costs little more than copying the memory involved.
+class StateWriter
+{
+public:
+	StateWriter(std::vector<uint8_t>& vOut) : vData(vOut) {}
+
+	void Write(const void* pSrc, size_t nBytes)
+	{
+		size_t nAt = vData.size();
+		vData.resize(nAt + nBytes);
+		std::memcpy(vData.data() + nAt, pSrc, nBytes);
+	}
+
+	template <typename T>
+	void Write(const T& v)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written to a state");
+		Write(&v, sizeof(T));
+	}
+
+private:
+	std::vector<uint8_t>& vData;
+};
+
+class StateReader
+{
+public:
+	StateReader(const uint8_t* pSrc, size_t nBytes) : pData(pSrc), nSize(nBytes) {}
+
+	// Reading past the end leaves the destination alone, and fails the
+	// whole read rather than each value having to be checked
+	void Read(void* pDst, size_t nBytes)
+	{
+		if (bFailed || nBytes > nSize - nPos)
+		{
+			bFailed = true;
+			return;
+		}
+
+		std::memcpy(pDst, pData + nPos, nBytes);
+		nPos += nBytes;
+	}
+
+	template <typename T>
+	void Read(T& v)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read from a state");
+		Read(&v, sizeof(T));
+	}
+
+	bool Failed() const { return bFailed; }
+	bool AtEnd() const { return nPos == nSize; }
+
+private:
+	const uint8_t* pData = nullptr;
+	size_t nSize = 0;
+	size_t nPos = 0;
+	bool bFailed = false;
+};
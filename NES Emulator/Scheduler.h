@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "SaveState.h"
+
+// Event Scheduler
+// Things the devices do to each other outside of register reads and writes,
+// e.g. the PPU interrupting the CPU, are events at a time on the master
+// clock, rather than flags the bus has to look at after every clock to see if
+// any have been raised. Each kind of event is either pending, at a time, or
+// not, and the earliest time of any is kept, so the bus need only compare the
+// clock against that one number. The master clock is 64-bit, which at the
+// NES's 21.47MHz goes round once every 27,000 years.
+class Scheduler
+{
+public:
+	Scheduler() { Clear(); }
+
+	enum EVENT : uint8_t
+	{
+		NMI,	// PPU has entered vertical blank with NMIs enabled
+		A12,	// PPU address line A12 rises, MMC3 counts scanlines by these
+		IRQ,	// Cartridge has started interrupting the CPU, and holds IRQ until acknowledged
+		EVENT_COUNT,
+	};
+
+	static constexpr uint64_t nNever = UINT64_MAX;
+
+	// Make an event due on a master clock, replacing any time it already had
+	void Schedule(EVENT e, uint64_t nClock)
+	{
+		// Moving the earliest event later means looking for the new earliest
+		bool bWasNext = nAt[e] == nNext;
+		nAt[e] = nClock;
+		if (nClock < nNext)
+			nNext = nClock;
+		else if (bWasNext)
+			Update();
+	}
+
+	// Make an event due as soon as the bus next looks, i.e. at the end of
+	// the master clock in progress. For devices which raise events while
+	// being clocked and have no need to know the time.
+	void Raise(EVENT e) { Schedule(e, 0); }
+
+	void Cancel(EVENT e)
+	{
+		nAt[e] = nNever;
+		Update();
+	}
+
+	// The earliest master clock any event is due
+	uint64_t Next() const { return nNext; }
+
+	// If an event is due by a master clock, it is taken and no longer pending
+	bool Take(EVENT e, uint64_t nClock)
+	{
+		if (nAt[e] > nClock)
+			return false;
+
+		nAt[e] = nNever;
+		Update();
+		return true;
+	}
+
+	void Clear()
+	{
+		nAt.fill(nNever);
+		nNext = nNever;
+	}
+
+	void saveState(StateWriter& state) const { state.Write(nAt); }
+	void loadState(StateReader& state) { state.Read(nAt); Update(); }
+
+private:
+	std::array<uint64_t, EVENT_COUNT> nAt;
+	uint64_t nNext = nNever;
+
+	void Update()
+	{
+		nNext = nNever;
+		for (uint64_t n : nAt)
+			nNext = n < nNext ? n : nNext;
+	}
+};
@@ -0,0 +1,48 @@
+#include "TileCache.h"
+
+#include <algorithm>
+
+void TileCache::Connect(const uint8_t* pMemory, size_t nSize)
+{
+	size_t nBanks = nSize >> 10;
+	this->pMemory = pMemory;
+	pRows.reset(new sRow[nBanks * nRowsPerBank]);
+	vValid.assign(nBanks, 0);
+}
+
+void TileCache::InvalidateAll()
+{
+	std::fill(vValid.begin(), vValid.end(), 0);
+}
+
+void TileCache::DecodeAll()
+{
+	for (size_t nBank = 0; nBank < vValid.size(); nBank++)
+		if (!vValid[nBank])
+			Decode(nBank);
+}
+
+void TileCache::Decode(size_t nBank)
+{
+	const uint8_t* pTile = pMemory + (nBank << 10);
+	sRow* pRow = &pRows[nBank * nRowsPerBank];
+
+	for (int nTile = 0; nTile < 64; nTile++, pTile += 16)
+	{
+		for (int y = 0; y < 8; y++, pRow++)
+		{
+			pRow->lo = pTile[y];
+			pRow->hi = pTile[y + 8];
+			pRow->lo_flipped = Flip(pRow->lo);
+			pRow->hi_flipped = Flip(pRow->hi);
+
+			for (int x = 0; x < 8; x++)
+			{
+				uint8_t bit = 0x80 >> x;
+				pRow->pixels[x] = ((pRow->lo & bit) ? 0x01 : 0x00) | ((pRow->hi & bit) ? 0x02 : 0x00);
+			}
+		}
+	}
+
+	vValid[nBank] = 1;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Decoded Pattern Tiles
+// Pattern memory stores each row of a tile as two bit planes, eight bytes
+// apart, which the renderer has to fetch separately and then pick apart a
+// bit at a time to find each pixel's colour, and sprites flipped
+// horizontally need their planes mirrored as well. This holds every row of
+// every tile already taken apart: the colour of each pixel in a byte of its
+// own, ready to be combined eight at a time, alongside both planes as they
+// are stored and mirrored. A row is found by the address of its low plane.
+//
+// Tiles are decoded a 1KB bank at a time, the granularity mappers switch
+// pattern memory in, and only once a bank is first used. The cache follows
+// the memory rather than the PPU's windows onto it, so switching banks
+// costs nothing, and decoded ROM is never stale. Writes to pattern RAM mark
+// the bank written as stale, and it is decoded again the next time it is
+// asked for. Pattern ROM is decoded in full, once, by the ROM image, and
+// shared read-only by every cartridge made from it.
+class TileCache
+{
+public:
+	struct sRow
+	{
+		uint8_t pixels[8];		// 2-bit colour of each pixel, left to right
+		uint8_t lo, hi;			// Bit planes as stored
+		uint8_t lo_flipped;		// And mirrored, for sprites flipped horizontally
+		uint8_t hi_flipped;
+		uint8_t unused[4];
+	};
+
+	static constexpr size_t nRowsPerBank = 64 * 8;
+
+	// The pattern memory to decode, a whole number of 1KB banks
+	void Connect(const uint8_t* pMemory, size_t nSize);
+
+	// The decoded rows of the 1KB bank starting at pBank, which must be one
+	// of the connected memory's. Valid until the bank is next invalidated.
+	const sRow* Bank(const uint8_t* pBank)
+	{
+		size_t nBank = (size_t)(pBank - pMemory) >> 10;
+		if (!vValid[nBank])
+			Decode(nBank);
+		return &pRows[nBank * nRowsPerBank];
+	}
+
+	// As Bank(), for a cache already decoded with DecodeAll() and never
+	// invalidated since, which is never written to and so can be shared
+	const sRow* Decoded(const uint8_t* pBank) const
+	{
+		return &pRows[((size_t)(pBank - pMemory) >> 10) * nRowsPerBank];
+	}
+
+	void DecodeAll();
+
+	// Index of a row within its bank's rows, from its low plane's address
+	static size_t RowIndex(uint16_t addr) { return ((addr & 0x03F0) >> 1) | (addr & 0x0007); }
+
+	// A byte mirrored, so 0b11100000 becomes 0b00000111. Stolen completely
+	// from here: https://stackoverflow.com/a/2602885
+	static uint8_t Flip(uint8_t b)
+	{
+		b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+		b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+		b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+		return b;
+	}
+
+	// Pattern memory at pAddress has been written
+	void Invalidate(const uint8_t* pAddress) { vValid[(size_t)(pAddress - pMemory) >> 10] = 0; }
+	void InvalidateAll();
+
+private:
+	const uint8_t* pMemory = nullptr;
+	std::unique_ptr<sRow[]> pRows; // Left uninitialised until each bank is decoded
+	std::vector<uint8_t> vValid;
+
+	void Decode(size_t nBank);
+};
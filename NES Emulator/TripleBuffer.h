@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hands whole objects, e.g. frames, from one thread to another without
+// either ever waiting on the other. There are three slots. The producer
+// fills the back one and publishes it, swapping it for the middle one,
+// and the consumer picks up the middle one when it wants a newer front
+// one. Frames the consumer is too slow to pick up are simply overwritten,
+// it always gets the latest complete one and never a partially written one.
+template <typename T>
+class TripleBuffer
+{
+public:
+	// Producer side
+	T& Back()
+	{
+		return slot[nBack];
+	}
+
+	void Publish()
+	{
+		nBack = nMiddle.exchange(nBack | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Consumer side. Returns true if Front() has changed.
+	bool Update()
+	{
+		if (!(nMiddle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+
+		nFront = nMiddle.exchange(nFront, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	const T& Front() const
+	{
+		return slot[nFront];
+	}
+
+private:
+	static constexpr uint8_t INDEX = 0x03;
+	static constexpr uint8_t FRESH = 0x04; // Middle slot holds a frame the consumer has not seen
+
+	T slot[3];
+	uint8_t nBack = 0; // Only touched by the producer
+	uint8_t nFront = 2; // Only touched by the consumer
+	std::atomic<uint8_t> nMiddle{ 1 };
+};
@@ -1,22 +1,57 @@
 #include "bus.h"
 
+#include <algorithm>
+#include <cstring>
+
 Bus::Bus()
 {
 	// Connect CPU to Communication Bus
 	cpu.ConnectBus(this);
+
+	// Devices raise their interrupts through the scheduler
+	ppu.ConnectScheduler(&scheduler);
+
+	MapCpuPages();
 }
 
 Bus::~Bus() = default;
 
 void Bus::SetSampleFrequency(uint32_t sample_rate)
 {
-	dAudioTimePerSystemSample = 1.0 / (double)sample_rate;
-	dAudioTimePerNESClock = 1.0 / 5369318.0; // PPU Clock Frequency
+	apu.SetSampleFrequency(sample_rate);
 }
 
+void Bus::FlushAudio()
+{
+	apu.EndAudioBlock(vAudioSamples);
+}
+
+
+// Rebuild the page tables from scratch. The internal RAM is always directly
+// accessible, as is whatever the cartridge maps straight onto PRG memory.
+// Everything else, including mapper registers, goes through the devices.
+void Bus::MapCpuPages()
+{
+	pCpuReadPage.fill(nullptr);
+	pCpuWritePage.fill(nullptr);
+
+	// 2KB of RAM, mirrored throughout 0x0000 - 0x1FFF
+	for (int page = 0x00; page <= 0x1F; page++)
+	{
+		pCpuReadPage[page] = &cpuRAM[(page & 0x07) << 8];
+		pCpuWritePage[page] = &cpuRAM[(page & 0x07) << 8];
+	}
 
-void Bus::cpuWrite(uint16_t addr, uint8_t data)
+	if (cart)
+		cart->cpuMapPages(pCpuReadPage.data(), pCpuWritePage.data());
+}
+
+void Bus::cpuWriteDevice(uint16_t addr, uint8_t data)
 {
+	// Writes to the PPU, APU and mapper registers change what those devices
+	// do from now on, so they must have caught up to this point first
+	if (bCpuAhead && ((addr >= 0x2000 && addr <= 0x4017) || addr >= 0x8000))
+		SyncDevices();
 
 	if (cart->cpuWrite(addr, data))
 	{
@@ -29,6 +64,10 @@ void Bus::cpuWrite(uint16_t addr, uint8_t data)
 	else if (addr >= 0x2000 && addr <= 0x3FFF)
 	{
 		ppu.cpuWrite(addr & 0x0007, data);
+
+		// Control and mask decide when A12 rises
+		if ((addr & 0x0007) <= 0x0001)
+			ScheduleA12(nSystemClockCounter + 1);
 	}
 	else if ((addr >= 0x4000 && addr <= 0x4013) || addr == 0x4015 || addr == 0x4017)
 	{
@@ -37,22 +76,37 @@ void Bus::cpuWrite(uint16_t addr, uint8_t data)
 	else if (addr == 0x4014)
 	{
 		// Write to this address initiates a DMA Transfer
-		dma_page = data;
-		dma_addr = 0x00;
-		dma_transfer = true;
+		OamDma(data);
 	}
 	else if (addr >= 0x4016 && addr <= 0x4017)
 	{
 		// "Lock in" controller state at this time
 		controller_state[addr & 0x0001] = controller[addr & 0x0001];
 	}
-	
 
+	// The write may have been to a mapper register, moving PRG banks about
+	// or changing how the nametables are mirrored
+	if (cart->cpuMapChanged())
+		MapCpuPages();
+	if (addr >= 0x8000 && cart->mirrorChanged())
+		ppu.MapNameTables();
+
+	// Or acknowledged its IRQ, releasing the line
+	if (cpu.irq_line && addr >= 0x8000 && !cart->GetMapper()->irqState())
+	{
+		cpu.irq_line = false;
+		scheduler.Cancel(Scheduler::IRQ);
+	}
 }
 
-uint8_t Bus::cpuRead(uint16_t addr, bool bReadOnly)
+uint8_t Bus::cpuReadDevice(uint16_t addr, bool bReadOnly)
 {
 	uint8_t data = 0x00;
+
+	// Reads of PPU and APU registers must see them as they are now
+	if (bCpuAhead && !bReadOnly && addr >= 0x2000 && addr <= 0x4017)
+		SyncDevices();
+
 	if (cart->cpuRead(addr, data))
 	{
 		// Cartridge Address Range
@@ -84,6 +138,17 @@ void Bus::insertCartridge(const std::shared_ptr<Cartridge>& cartridge)
 {
 	this->cart = cartridge;
 	ppu.ConnectCartridge(cartridge);
+	if (cart->GetMapper())
+		cart->GetMapper()->ConnectScheduler(&scheduler);
+	bCountScanlines = cart->GetMapper() && cart->GetMapper()->countsScanlines();
+	MapCpuPages();
+	cart->mirrorChanged();
+	ppu.MapNameTables();
+	cpu.irq_line = false;
+
+	// The cartridge that was in before may have been counting scanlines
+	scheduler.Cancel(Scheduler::A12);
+	ScheduleA12(nSystemClockCounter);
 
 }
 
@@ -91,84 +156,376 @@ void Bus::reset()
 {
 	cpu.reset();
 	cart->reset();
+	MapCpuPages();
+	cart->mirrorChanged();
+	ppu.MapNameTables();
+	cpu.irq_line = false;
 	ppu.reset();
+	scheduler.Clear();
 	nSystemClockCounter = 0;
-	dma_page = 0x00;
-	dma_addr = 0x00;
-	dma_data = 0x00;
-	dma_dummy = true;
-	dma_transfer = false;
+	nCpuPhase = 0;
+	nCpuResume = 0;
+	ScheduleA12(nSystemClockCounter);
+	bCatchUpPrimed = false;
+	bDevicesHalfClocked = false;
 }
 
-bool Bus::clock()
+void Bus::clock()
+{
+	// Coming out of catch-up execution, bring the devices level with the CPU
+	if (bCatchUpPrimed)
+		ReleaseCatchUp();
+
+	ClockDevices();
+
+	// CPU runs 3 times slower than the PPU, and not at all while stalled
+	if (nCpuPhase == 0 && nSystemClockCounter >= nCpuResume)
+		cpu.clock();
+
+	ClockComplete();
+}
+
+// First half of a master clock, before the CPU gets its turn
+void Bus::ClockDevices()
 {
 	ppu.clock(); // PPU is the fastest clock frequency
 
 	apu.clock(); // Clock the APU as well
+}
 
-	if (nSystemClockCounter % 3 == 0) // CPU runs 3 times slower than the PPU
+// Second half of a master clock, after the CPU has had its turn
+void Bus::ClockComplete()
+{
+	// Anything raised during this clock, or due on it, is taken now
+	if (nSystemClockCounter >= scheduler.Next())
+		RunEvents();
+
+	nSystemClockCounter++;
+	if (++nCpuPhase == 3)
+		nCpuPhase = 0;
+}
+
+void Bus::RunEvents()
+{
+	// A12 has risen, the mapper counts a scanline, and may raise its IRQ in
+	// doing so, which is taken below. The PPU is part way through this
+	// clock, so the next edge is counted from the next.
+	if (scheduler.Take(Scheduler::A12, nSystemClockCounter))
 	{
-		if (dma_transfer) // Is the system performing a DMA transfer from CPU memory to OAM memory on PPU?
-		{
-			if (dma_dummy) // Yes, wait until the next even CPU clock cycle
-			{
-				if (nSystemClockCounter % 2 == 1) // Wait here until 1 or 2 cycles have elapsed
-				{
-					dma_dummy = false; // Allow DMA to start
-				}
-			}
-			else
-			{
-				if (nSystemClockCounter % 2 == 0) // DMA Start
-				{
-					dma_data = cpuRead(dma_page << 8 | dma_addr); // On even clock cycles, read from CPU Bus
-				}
-				else
-				{
-					ppu.pOAM[dma_addr] = dma_data; // On odd clock cycles, write to PPU OAM
-					dma_addr++; // Increment the lo byte of the address
-
-					if (dma_addr == 0x00) // If it wraps around, we know 256 bytes have been written so end DMA.
-					{
-						dma_transfer = false;
-						dma_dummy = true;
-					}
-				}
-			}
-		}
-		else
+		cart->GetMapper()->scanline();
+		ScheduleA12(nSystemClockCounter + 1);
+	}
+
+	// PPU is capable of emitting an interrupt to indicate the vertical blanking period has been entered.
+	// If it has, we need to send that IRQ to the CPU.
+	if (scheduler.Take(Scheduler::NMI, nSystemClockCounter))
+		cpu.nmi();
+
+	// Cartridge is requesting IRQ. It holds the line until the interrupt is
+	// acknowledged, so if interrupts are disabled now, the CPU takes it once
+	// they are enabled again.
+	if (scheduler.Take(Scheduler::IRQ, nSystemClockCounter))
+	{
+		cpu.irq_line = true;
+		cpu.irq();
+	}
+}
+
+void Bus::OamDma(uint8_t page)
+{
+	// The whole page is copied at once rather than a byte every other cycle.
+	// The CPU, which is all that writes to the page, is suspended meanwhile,
+	// so only how long the transfer takes needs modelling.
+	if (pCpuReadPage[page])
+	{
+		std::memcpy(ppu.pOAM, pCpuReadPage[page], 256);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < 256; i++)
+			ppu.pOAM[i] = cpuRead((page << 8) | i);
+	}
+
+	// The CPU is suspended from its next cycle, for a cycle if that is odd
+	// or two if it is even, to wait for an odd one, then 256 pairs of read
+	// and write cycles
+	uint64_t nStart = NextCpuClock() + 3;
+	nCpuResume = nStart + 3 * ((nStart & 1) ? 513 : 514);
+}
+
+void Bus::ScheduleA12(uint64_t nNextDot)
+{
+	if (!bCountScanlines)
+		return;
+
+	uint32_t nDots = ppu.DotsUntilA12();
+	if (nDots == UINT32_MAX)
+		scheduler.Cancel(Scheduler::A12);
+	else
+		scheduler.Schedule(Scheduler::A12, nNextDot + nDots);
+}
+
+void Bus::SetCatchUp(bool bEnable)
+{
+	if (!bEnable && bCatchUpPrimed)
+		ReleaseCatchUp();
+
+	bCatchUp = bEnable;
+}
+
+// The next master clock on which the CPU is clocked
+uint64_t Bus::NextCpuClock() const
+{
+	return nSystemClockCounter + (3 - nCpuPhase) % 3;
+}
+
+// The next master clock on which the CPU counts down cycles, which is later
+// while it is suspended for DMA
+uint64_t Bus::CpuResumeClock() const
+{
+	return std::max(NextCpuClock(), nCpuResume);
+}
+
+// Swap per cycle bookkeeping for catch-up bookkeeping. The cycles the CPU
+// still has to burn become the master clock of its next instruction.
+void Bus::PrimeCatchUp()
+{
+	nCpuClock = CpuResumeClock() + 3 * cpu.cycles;
+	nCpuLastClock = nSystemClockCounter - 1;
+	cpu.cycles = 0;
+	bCatchUpPrimed = true;
+}
+
+// And back again. The devices must first have passed the last instruction
+// the CPU executed ahead of them, after which the CPU is in exactly the state
+// the per cycle path would have left it in.
+void Bus::ReleaseCatchUp()
+{
+	if ((int64_t)(nSystemClockCounter - nCpuLastClock) <= 0)
+		CatchUpTicks((uint32_t)(nCpuLastClock - nSystemClockCounter + 1));
+
+	cpu.cycles = (uint8_t)((nCpuClock - CpuResumeClock()) / 3);
+	bCatchUpPrimed = false;
+}
+
+// Clock the devices for one whole master clock on which the CPU does nothing
+void Bus::CatchUpTick()
+{
+	ClockDevices();
+	CatchUpComplete();
+}
+
+// Clock the devices for a number of master clocks on which the CPU does
+// nothing. The PPU runs through as many of them as it can in one go, which
+// lets it draw whole scanlines, but stops short of raising an NMI, or of
+// any scheduled event, so that they are taken on the correct clock.
+void Bus::CatchUpTicks(uint32_t nTicks)
+{
+	while (nTicks > 0)
+	{
+		uint64_t nEvent = scheduler.Next() > nSystemClockCounter ? scheduler.Next() - nSystemClockCounter : 0;
+		uint32_t nBatch = (uint32_t)std::min<uint64_t>(std::min(nTicks, ppu.DotsUntil(241, 1)), nEvent);
+		if (nBatch == 0)
 		{
-			cpu.clock(); // Clock as normal
+			CatchUpTick();
+			nTicks--;
+			continue;
 		}
+
+		ppu.run(nBatch);
+		apu.run(nBatch);
+		for (uint32_t i = 0; i < nBatch; i++)
+			CatchUpComplete();
+
+		nTicks -= nBatch;
 	}
+}
 
-	// Audio Synchronization
-	bool bAudioSampleReady = false;
-	dAudioTime += dAudioTimePerNESClock;
-	
-	if (dAudioTime >= dAudioTimePerSystemSample)
+// Second half of a master clock in catch-up mode
+void Bus::CatchUpComplete()
+{
+	ClockComplete();
+
+	// Taking an interrupt sets the number of cycles before the CPU
+	// continues, convert that to the master clock it resumes on. Nothing
+	// can interrupt an instruction being executed ahead, and its own cycles
+	// are accounted for once it returns.
+	if (!bCpuAhead && cpu.cycles > 0)
 	{
-		dAudioTime -= dAudioTimePerSystemSample;
-		dAudioSample = apu.GetOutputSample();
-		bAudioSampleReady = true;
+		nCpuClock = CpuResumeClock() + 3 * cpu.cycles;
+		cpu.cycles = 0;
 	}
+}
 
-	// PPU is capable of emitting an interrupt to indicate the vertical blanking period has been entered.
-	// If it has, we need to send that IRQ to the CPU.
-	if (ppu.nmi)
+// Called from within an instruction the CPU is executing ahead of the
+// devices. Run them up to the master clock the instruction executes on,
+// including the half of that clock which precedes the CPU.
+void Bus::SyncDevices()
+{
+	if (bDevicesHalfClocked)
+		return;
+
+	// Nothing can interrupt the CPU in here, that was checked before the
+	// instruction was allowed to run ahead
+	CatchUpTicks((uint32_t)(nCpuClock - nSystemClockCounter));
+
+	ClockDevices();
+	bDevicesHalfClocked = true;
+}
+
+uint8_t Bus::step()
+{
+	if (!bCatchUpPrimed)
+		PrimeCatchUp();
+
+	// The CPU may only run ahead of the devices if they cannot interrupt it
+	// in the meantime. If the PPU will raise an NMI, or an event is due,
+	// before the CPU's next instruction, clock the devices past it, which
+	// delays the instruction if it interrupts.
+	for (;;)
 	{
-		ppu.nmi = false;
-		cpu.nmi();
+		uint64_t nInterrupt = std::min(nSystemClockCounter + ppu.DotsUntil(241, 1), scheduler.Next());
+		if (nInterrupt >= nCpuClock)
+			break;
+		CatchUpTicks(nInterrupt > nSystemClockCounter ? (uint32_t)(nInterrupt - nSystemClockCounter) : 1);
 	}
 
-	// Check if cartridge is requesting IRQ
-	if (cart->GetMapper()->irqState())
+	uint64_t nClock = nCpuClock;
+
+	bCpuAhead = true;
+	uint8_t nCycles = cpu.step();
+	bCpuAhead = false;
+
+	// The instruction's first cycle was its own, the rest follow any DMA it
+	// started
+	nCpuClock = std::max(nClock + 3, nCpuResume) + 3 * (nCycles - 1);
+	nCpuLastClock = nClock;
+
+	// If the instruction synchronised the devices, they are part way through
+	// its master clock. Finish it, so anything raised on it is taken after the
+	// instruction, just as it would be per cycle.
+	if (bDevicesHalfClocked)
 	{
-		cart->GetMapper()->irqClear();
-		cpu.irq();
+		bDevicesHalfClocked = false;
+		CatchUpComplete();
 	}
 
-	nSystemClockCounter++;
+	return nCycles;
+}
+
+void Bus::saveState(std::vector<uint8_t>& vState, bool bScreen)
+{
+	if (bCatchUpPrimed)
+		ReleaseCatchUp();
+
+	vState.clear();
+	StateWriter state(vState);
+
+	state.Write(nStateMagic);
+	state.Write(nStateVersion);
+	state.Write(bScreen);
+
+	state.Write(nSystemClockCounter);
+	scheduler.saveState(state);
+	state.Write(cpuRAM);
+	state.Write(controller_state);
+	state.Write(nCpuResume);
+
+	cpu.saveState(state);
+	ppu.saveState(state, bScreen);
+	apu.saveState(state);
+	cart->saveState(state);
+}
+
+bool Bus::loadState(const uint8_t* pState, size_t nSize)
+{
+	uint32_t nMagic = 0, nVersion = 0;
+	StateReader header(pState, nSize);
+	header.Read(nMagic);
+	header.Read(nVersion);
+
+	if (header.Failed() || nMagic != nStateMagic || nVersion != nStateVersion)
+		return false;
+
+	// Anything else wrong with the state is only found part way through
+	// reading it, by which time the console has been partly overwritten
+	saveState(vStateBackup);
+
+	if (!readState(pState, nSize))
+	{
+		readState(vStateBackup.data(), vStateBackup.size());
+		return false;
+	}
+
+	return true;
+}
+
+bool Bus::readState(const uint8_t* pState, size_t nSize)
+{
+	StateReader state(pState, nSize);
+
+	uint32_t nMagic = 0, nVersion = 0;
+	bool bScreen = false;
+	state.Read(nMagic);
+	state.Read(nVersion);
+	state.Read(bScreen);
+
+	state.Read(nSystemClockCounter);
+	nCpuPhase = (uint8_t)(nSystemClockCounter % 3);
+	scheduler.loadState(state);
+	state.Read(cpuRAM);
+	state.Read(controller_state);
+	state.Read(nCpuResume);
+
+	cpu.loadState(state);
+	ppu.loadState(state, bScreen);
+	apu.loadState(state);
+	bool bCartridge = cart->loadState(state);
+
+	// The state is of the console as clocked per cycle
+	bCatchUpPrimed = false;
+	bCpuAhead = false;
+	bDevicesHalfClocked = false;
+
+	// The mapper's banks and mirroring have moved
+	cart->cpuMapChanged();
+	MapCpuPages();
+	cart->mirrorChanged();
+	ppu.MapNameTables();
+
+	// Whether the cartridge is holding IRQ is part of its state
+	cpu.irq_line = cart->GetMapper()->irqState();
+
+	return bCartridge && !state.Failed() && state.AtEnd();
+}
+
+void Bus::frame()
+{
+	if (!bCatchUp)
+	{
+		// Clock enough times to draw a single frame
+		do { clock(); } while (!ppu.frame_complete);
+		ppu.frame_complete = false;
+		FlushAudio();
+		return;
+	}
+
+	if (!bCatchUpPrimed)
+		PrimeCatchUp();
+
+	while (!ppu.frame_complete)
+	{
+		// Run the CPU up to the end of the frame, then bring the devices
+		// up to it. The end may be predicted one clock early, hence the loop.
+		uint64_t nFrameEnd = nSystemClockCounter + ppu.DotsUntil(260, 340) + 1;
+
+		while ((int64_t)(nCpuClock - nFrameEnd) < 0)
+			step();
+
+		if ((int64_t)(nSystemClockCounter - nFrameEnd) < 0)
+			CatchUpTicks((uint32_t)(nFrameEnd - nSystemClockCounter));
+	}
 
-	return bAudioSampleReady;
+	ppu.frame_complete = false;
+	FlushAudio();
 }
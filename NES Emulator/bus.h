@@ -2,11 +2,14 @@
 
 #include <cstdint>
 #include <array>
+#include <vector>
 
 #include "olc6502.h"
 #include "olc2C02.h"
 #include "olc2A03.h"
 #include "Cartridge.h"
+#include "SaveState.h"
+#include "Scheduler.h"
 
 class Bus
 {
@@ -29,46 +32,122 @@ public:
 	std::array<uint8_t, 2048> cpuRAM = { 0x00 };
 
 	// Controllers
-	std::array<uint8_t, 2> controller;
+	std::array<uint8_t, 2> controller = { 0x00 };
 
 	// The Cartridge or "GamePak"
 	std::shared_ptr<Cartridge> cart;
 
 	// Bus Read & Write
-	void cpuWrite(uint16_t addr, uint8_t data);
-	uint8_t cpuRead(uint16_t addr, bool bReadOnly = false);
+	// Pages of plain memory are accessed directly through the page tables,
+	// anything else is decoded to the device responsible for it
+	void cpuWrite(uint16_t addr, uint8_t data)
+	{
+		if (pCpuWritePage[addr >> 8]) pCpuWritePage[addr >> 8][addr & 0x00FF] = data;
+		else cpuWriteDevice(addr, data);
+	}
+
+	uint8_t cpuRead(uint16_t addr, bool bReadOnly = false)
+	{
+		if (pCpuReadPage[addr >> 8]) return pCpuReadPage[addr >> 8][addr & 0x00FF];
+		return cpuReadDevice(addr, bReadOnly);
+	}
 
 	// System Interface
 	void insertCartridge(const std::shared_ptr<Cartridge>& cartridge);
 	void reset();
-	bool clock();
+	void clock();
+
+	// Catch-up Execution
+	// Rather than interleaving the CPU with the PPU and APU one master clock
+	// at a time, the CPU executes whole instructions ahead of the other
+	// devices, which are then advanced in bulk. They are only brought level
+	// with the CPU when it touches one of their registers, or when they are
+	// due to interrupt it, so the result is identical to clocking per cycle.
+	void SetCatchUp(bool bEnable);
+	uint8_t step(); // Execute one CPU instruction, returns the CPU cycles it took
+	void frame(); // Run until the PPU completes a frame, in either mode
 
 	// System Audio Synchronization
+	// Audio is synthesised in blocks rather than sample by sample. frame()
+	// appends the samples for the whole frame to vAudioSamples, anything
+	// driving the NES with clock() or step() calls FlushAudio() itself.
+	// The owner drains vAudioSamples as it sees fit.
 	void SetSampleFrequency(uint32_t sample_rate);
-	double dAudioSample = 0.0;
+	void FlushAudio();
+	std::vector<float> vAudioSamples;
+
+	// Save States
+	// A snapshot of the whole console and its cartridge, in a compact binary
+	// form quick enough to take every frame. A state is always of the console
+	// as clocked per cycle, so catch-up execution is brought level first.
+	// Loading fails, leaving the console as it was, if the state is from
+	// another version or another cartridge, or is incomplete. The picture
+	// being drawn may be left out, as the next frame replaces it anyway,
+	// in which case loading the state leaves the picture as it is.
+	static constexpr uint32_t nStateVersion = 7;
+	void saveState(std::vector<uint8_t>& vState, bool bScreen = true);
+	bool loadState(const uint8_t* pState, size_t nSize);
+	bool loadState(const std::vector<uint8_t>& vState) { return loadState(vState.data(), vState.size()); }
 
 private:
-	// A count of how many clocks have passed
-	uint32_t nSystemClockCounter = 0;
+	// A count of how many clocks have passed, and of where that is in the
+	// CPU's clock, which is every third
+	uint64_t nSystemClockCounter = 0;
+	uint8_t nCpuPhase = 0;
+
+	// Interrupts and anything else due on a particular clock
+	Scheduler scheduler;
+	void RunEvents();
+
+	// Scanline counting mappers are clocked by the PPU's A12 edges, which
+	// are predicted and scheduled rather than looked for on every dot. The
+	// prediction is redone whenever the PPU registers it depends on are
+	// written, and after each edge for the next one.
+	bool bCountScanlines = false;
+	void ScheduleA12(uint64_t nNextDot); // nNextDot is the clock the PPU processes its next dot on
+
+	// CPU memory map, one entry per 256 byte page of the address space.
+	// Each is either a pointer to the memory occupying that page, or
+	// nullptr if accesses need decoding by cpuWriteDevice()/cpuReadDevice().
+	std::array<uint8_t*, 256> pCpuReadPage = { nullptr };
+	std::array<uint8_t*, 256> pCpuWritePage = { nullptr };
+	void MapCpuPages();
+
+	void cpuWriteDevice(uint16_t addr, uint8_t data);
+	uint8_t cpuReadDevice(uint16_t addr, bool bReadOnly);
+
+	// The two halves of a master clock, either side of the CPU
+	void ClockDevices();
+	void ClockComplete();
+
+	// Catch-up execution state
+	bool bCatchUp = false;
+	bool bCatchUpPrimed = false; // CPU timing is held in nCpuClock rather than cpu.cycles
+	bool bCpuAhead = false; // CPU is executing an instruction ahead of the devices
+	bool bDevicesHalfClocked = false; // Devices have run the first half of the CPU's master clock
+	uint64_t nCpuClock = 0; // Master clock on which the CPU executes its next instruction
+	uint64_t nCpuLastClock = 0; // Master clock of the last instruction executed ahead
+
+	void PrimeCatchUp();
+	void ReleaseCatchUp();
+	void CatchUpTick();
+	void CatchUpTicks(uint32_t nTicks);
+	void CatchUpComplete();
+	void SyncDevices();
+	uint64_t NextCpuClock() const;
+	uint64_t CpuResumeClock() const;
+
+	// Save States
+	static constexpr uint32_t nStateMagic = 0x5353454E; // "NESS"
+	std::vector<uint8_t> vStateBackup;
+	bool readState(const uint8_t* pState, size_t nSize);
 
 	// Internal cache of controller state
-	uint8_t controller_state[2];
+	uint8_t controller_state[2] = { 0x00 };
 
-	// DMA from CPU Bus Memory to OAM Memory
-	uint8_t dma_page = 0x00;
-	uint8_t dma_addr = 0x00;
-	uint8_t dma_data = 0x00;
-
-	// Dummy cycle of idleness needed for an "even" clock cycle
-	bool dma_dummy = true;
-
-	// Flag to indicate DMA transfer is happening
-	bool dma_transfer = false;
-
-	// System Audio Synchronization
-	double dAudioTime = 0.0;
-	double dAudioGlobalTime = 0.0;
-	double dAudioTimePerNESClock = 0.0;
-	double dAudioTimePerSystemSample = 0.0f;
+	// DMA from CPU Bus Memory to OAM Memory, which suspends the CPU until
+	// the master clock it would have finished on
+	uint64_t nCpuResume = 0;
+	void OamDma(uint8_t page);
 };
 
@@ -1,6 +1,8 @@
 #include "olc2A03.h"
 
-uint8_t olc2A03::length_table[] = { 10, 254, 20,  2, 40,  4, 80,  6,
+#include <algorithm>
+
+const uint8_t olc2A03::length_table[] = { 10, 254, 20,  2, 40,  4, 80,  6,
 									160,   8, 60, 10, 14, 12, 26, 14,
 									 12,  16, 24, 18, 48, 20, 96, 22,
 									192,  24, 72, 26, 16, 28, 32, 30 };
@@ -22,10 +24,10 @@ void olc2A03::cpuWrite(uint16_t addr, uint8_t data)
 	case 0x4000:
 		switch ((data & 0xC0) >> 6)
 		{
-		case 0x00: pulse1_seq.new_sequence = 0b01000000; pulse1_osc.dutycycle = 0.125; break;
-		case 0x01: pulse1_seq.new_sequence = 0b01100000; pulse1_osc.dutycycle = 0.250; break;
-		case 0x02: pulse1_seq.new_sequence = 0b01111000; pulse1_osc.dutycycle = 0.500; break;
-		case 0x03: pulse1_seq.new_sequence = 0b10011111; pulse1_osc.dutycycle = 0.750; break;
+		case 0x00: pulse1_seq.new_sequence = 0b01000000; break;
+		case 0x01: pulse1_seq.new_sequence = 0b01100000; break;
+		case 0x02: pulse1_seq.new_sequence = 0b01111000; break;
+		case 0x03: pulse1_seq.new_sequence = 0b10011111; break;
 		}
 		pulse1_seq.sequence = pulse1_seq.new_sequence;
 		pulse1_halt = (data & 0x20);
@@ -56,10 +58,10 @@ void olc2A03::cpuWrite(uint16_t addr, uint8_t data)
 	case 0x4004:
 		switch ((data & 0xC0) >> 6)
 		{
-		case 0x00: pulse2_seq.new_sequence = 0b01000000; pulse2_osc.dutycycle = 0.125; break;
-		case 0x01: pulse2_seq.new_sequence = 0b01100000; pulse2_osc.dutycycle = 0.250; break;
-		case 0x02: pulse2_seq.new_sequence = 0b01111000; pulse2_osc.dutycycle = 0.500; break;
-		case 0x03: pulse2_seq.new_sequence = 0b10011111; pulse2_osc.dutycycle = 0.750; break;
+		case 0x00: pulse2_seq.new_sequence = 0b01000000; break;
+		case 0x01: pulse2_seq.new_sequence = 0b01100000; break;
+		case 0x02: pulse2_seq.new_sequence = 0b01111000; break;
+		case 0x03: pulse2_seq.new_sequence = 0b10011111; break;
 		}
 		pulse2_seq.sequence = pulse2_seq.new_sequence;
 		pulse2_halt = (data & 0x20);
@@ -158,9 +160,6 @@ void olc2A03::clock()
 	bool bQuarterFrameClock = false;
 	bool bHalfFrameClock = false;
 
-	dGlobalTime += (0.3333333333 / 1789773);
-
-
 	if (clock_counter % 6 == 0)
 	{
 		frame_clock_counter++;
@@ -212,70 +211,73 @@ void olc2A03::clock()
 			pulse2_sweep.clock(pulse2_seq.reload, 1);
 		}
 
-		//	if (bUseRawMode)
-		{
-			// Update Pulse1 Channel ================================
-			pulse1_seq.clock(pulse1_enable, [](uint32_t& s)
-				{
-					// Shift right by 1 bit, wrapping around
-					s = ((s & 0x0001) << 7) | ((s & 0x00FE) >> 1);
-				});
-
-			//	pulse1_sample = (double)pulse1_seq.output;
-		}
-		//else
-		{
-			pulse1_osc.frequency = 1789773.0 / (16.0 * (double)(pulse1_seq.reload + 1));
-			pulse1_osc.amplitude = (double)(pulse1_env.output - 1) / 16.0;
-			pulse1_sample = pulse1_osc.sample(dGlobalTime);
-
-			if (pulse1_lc.counter > 0 && pulse1_seq.timer >= 8 && !pulse1_sweep.mute && pulse1_env.output > 2)
-				pulse1_output += (pulse1_sample - pulse1_output) * 0.5;
-			else
-				pulse1_output = 0;
-		}
+		// Update Pulse1, Pulse2 and Noise Channels ===========
+		pulse1_seq.clock(pulse1_enable);
+		pulse2_seq.clock(pulse2_enable);
+		noise_seq.clock(noise_enable);
 
-		//if (bUseRawMode)
-		{
-			// Update Pulse1 Channel ================================
-			pulse2_seq.clock(pulse2_enable, [](uint32_t& s)
-				{
-					// Shift right by 1 bit, wrapping around
-					s = ((s & 0x0001) << 7) | ((s & 0x00FE) >> 1);
-				});
+		uint8_t nPulse1, nPulse2, nNoise;
+		ChannelVolumes(nPulse1, nPulse2, nNoise);
 
-			//	pulse2_sample = (double)pulse2_seq.output;
+		UpdateLevel(pulse1_level, pulse1_seq.output * nPulse1, clock_counter);
+		UpdateLevel(pulse2_level, pulse2_seq.output * nPulse2, clock_counter);
+		UpdateLevel(noise_level, noise_seq.output * nNoise, clock_counter);
+	}
 
-		}
-		//	else
-		{
-			pulse2_osc.frequency = 1789773.0 / (16.0 * (double)(pulse2_seq.reload + 1));
-			pulse2_osc.amplitude = (double)(pulse2_env.output - 1) / 16.0;
-			pulse2_sample = pulse2_osc.sample(dGlobalTime);
-
-			if (pulse2_lc.counter > 0 && pulse2_seq.timer >= 8 && !pulse2_sweep.mute && pulse2_env.output > 2)
-				pulse2_output += (pulse2_sample - pulse2_output) * 0.5;
-			else
-				pulse2_output = 0;
-		}
+	TrackChanges();
 
+	clock_counter++;
+}
 
-		noise_seq.clock(noise_enable, [](uint32_t& s)
-			{
-				s = (((s & 0x0001) ^ ((s & 0x0002) >> 1)) << 14) | ((s & 0x7FFF) >> 1);
-			});
+void olc2A03::run(uint32_t nTicks)
+{
+	// The first tick always goes through clock(), so that anything the CPU
+	// wrote just before has been seen by the sweepers
+	bool bTracked = false;
 
-		if (noise_lc.counter > 0 && noise_seq.timer >= 8)
+	while (nTicks > 0)
+	{
+		uint32_t nSteps = std::min(nTicks / 6, QuietSteps());
+		if (!bTracked || clock_counter % 6 != 0 || nSteps == 0)
 		{
-			noise_output = (double)noise_seq.output * ((double)(noise_env.output - 1) / 16.0);
+			clock();
+			bTracked = true;
+			nTicks--;
+			continue;
 		}
 
-		if (!pulse1_enable) pulse1_output = 0;
-		if (!pulse2_enable) pulse2_output = 0;
-		if (!noise_enable) noise_output = 0;
+		// Nothing but the sequencers changes until the frame sequencer's
+		// next beat, so the volume each channel plays at is fixed
+		uint8_t nPulse1, nPulse2, nNoise;
+		ChannelVolumes(nPulse1, nPulse2, nNoise);
+
+		RunChannel(pulse1_seq, pulse1_enable, nPulse1, pulse1_level, nSteps);
+		RunChannel(pulse2_seq, pulse2_enable, nPulse2, pulse2_level, nSteps);
+		RunChannel(noise_seq, noise_enable, nNoise, noise_level, nSteps);
 
+		frame_clock_counter += nSteps;
+		clock_counter += nSteps * 6;
+		nTicks -= nSteps * 6;
+
+		TrackChanges();
 	}
+}
 
+// Each channel outputs its sequencer's bit at the envelope's volume,
+// unless it has been silenced
+void olc2A03::ChannelVolumes(uint8_t& pulse1, uint8_t& pulse2, uint8_t& noise) const
+{
+	bool bPulse1 = pulse1_enable && pulse1_lc.counter > 0 && pulse1_seq.reload >= 8 && !pulse1_sweep.mute;
+	bool bPulse2 = pulse2_enable && pulse2_lc.counter > 0 && pulse2_seq.reload >= 8 && !pulse2_sweep.mute;
+	bool bNoise = noise_enable && noise_lc.counter > 0;
+
+	pulse1 = bPulse1 ? (uint8_t)pulse1_env.output : 0;
+	pulse2 = bPulse2 ? (uint8_t)pulse2_env.output : 0;
+	noise = bNoise ? (uint8_t)noise_env.output : 0;
+}
+
+void olc2A03::TrackChanges()
+{
 	// Frequency sweepers change at high frequency
 	pulse1_sweep.track(pulse1_seq.reload);
 	pulse2_sweep.track(pulse2_seq.reload);
@@ -283,25 +285,100 @@ void olc2A03::clock()
 	pulse1_visual = (pulse1_enable && pulse1_env.output > 1 && !pulse1_sweep.mute) ? pulse1_seq.reload : 2047;
 	pulse2_visual = (pulse2_enable && pulse2_env.output > 1 && !pulse2_sweep.mute) ? pulse2_seq.reload : 2047;
 	noise_visual = (noise_enable && noise_env.output > 1) ? noise_seq.reload : 2047;
+}
 
-	clock_counter++;
+// APU steps, including this one if it is due, before the frame sequencer
+// next adjusts the envelopes, length counters or sweepers
+uint32_t olc2A03::QuietSteps() const
+{
+	if (frame_clock_counter < 3729) return 3729 - 1 - frame_clock_counter;
+	if (frame_clock_counter < 7457) return 7457 - 1 - frame_clock_counter;
+	if (frame_clock_counter < 11186) return 11186 - 1 - frame_clock_counter;
+	return 14916 - 1 - frame_clock_counter;
 }
 
-double olc2A03::GetOutputSample()
+// Clock a channel for a number of APU steps, the first on the current
+// clock and the rest every 6 clocks after it. The first is taken just as
+// clock() would, as the channel's level may not yet reflect its volume,
+// after which the sequencer is advanced from one change in output to the next.
+template <typename Step>
+void olc2A03::RunChannel(sequencer<Step>& seq, bool bEnable, uint8_t volume, uint8_t& level, uint32_t nSteps)
 {
-	if (bUseRawMode)
+	seq.clock(bEnable);
+	UpdateLevel(level, seq.output * volume, clock_counter);
+
+	if (!bEnable)
+		return;
+
+	uint32_t nStep = 1;
+	while (nStep < nSteps)
 	{
-		return (pulse1_sample - 0.5) * 0.5
-			+ (pulse2_sample - 0.5) * 0.5;
+		nStep += seq.advance(nSteps - nStep);
+		UpdateLevel(level, seq.output * volume, clock_counter + (nStep - 1) * 6);
 	}
-	else
+}
+
+// Record a change in a channel's level as a step in the output, at the clock
+// it happens on. All channels are mixed linearly, at the same volume.
+void olc2A03::UpdateLevel(uint8_t& level, uint8_t new_level, uint32_t clock)
+{
+	if (new_level != level)
 	{
-		return ((1.0 * pulse1_output) - 0.8) * 0.1 +
-			((1.0 * pulse2_output) - 0.8) * 0.1 +
-			((2.0 * (noise_output - 0.5))) * 0.1;
+		blip.AddDelta(clock - block_start, (int32_t)new_level - (int32_t)level);
+		level = new_level;
 	}
 }
 
+void olc2A03::SetSampleFrequency(uint32_t sample_rate)
+{
+	blip.SetRates(5369318.0, (double)sample_rate, 0.2f / 16.0f); // Clocked at the PPU Clock Frequency
+	block_start = clock_counter;
+}
+
+void olc2A03::EndAudioBlock(std::vector<float>& vOut)
+{
+	blip.EndBlock(clock_counter - block_start, vOut);
+	block_start = clock_counter;
+}
+
+void olc2A03::saveState(StateWriter& state) const
+{
+	state.Write(frame_clock_counter);
+	state.Write(clock_counter);
+
+	state.Write(pulse1_enable); state.Write(pulse1_halt);
+	pulse1_seq.saveState(state); pulse1_env.saveState(state); pulse1_lc.saveState(state); pulse1_sweep.saveState(state);
+
+	state.Write(pulse2_enable); state.Write(pulse2_halt);
+	pulse2_seq.saveState(state); pulse2_env.saveState(state); pulse2_lc.saveState(state); pulse2_sweep.saveState(state);
+
+	state.Write(noise_enable); state.Write(noise_halt);
+	noise_seq.saveState(state); noise_env.saveState(state); noise_lc.saveState(state);
+}
+
+void olc2A03::loadState(StateReader& state)
+{
+	// The clocks already in the current audio block stay in it
+	uint32_t nBlockClocks = clock_counter - block_start;
+
+	state.Read(frame_clock_counter);
+	state.Read(clock_counter);
+
+	state.Read(pulse1_enable); state.Read(pulse1_halt);
+	pulse1_seq.loadState(state); pulse1_env.loadState(state); pulse1_lc.loadState(state); pulse1_sweep.loadState(state);
+
+	state.Read(pulse2_enable); state.Read(pulse2_halt);
+	pulse2_seq.loadState(state); pulse2_env.loadState(state); pulse2_lc.loadState(state); pulse2_sweep.loadState(state);
+
+	state.Read(noise_enable); state.Read(noise_halt);
+	noise_seq.loadState(state); noise_env.loadState(state); noise_lc.loadState(state);
+
+	// The channel levels are left as they are, so the next step
+	// simply moves the output from the old sound to the new one
+	block_start = clock_counter - nBlockClocks;
+	TrackChanges();
+}
+
 void olc2A03::reset()
 {
 }
\ No newline at end of file
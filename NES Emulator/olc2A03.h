@@ -1,7 +1,10 @@
 #pragma once
 
 #include <cstdint>
-#include <functional>
+#include <vector>
+
+#include "BlipBuffer.h"
+#include "SaveState.h"
 
 class olc2A03
 {
@@ -12,9 +15,18 @@ public:
 	void cpuWrite(uint16_t addr, uint8_t data);
 	uint8_t cpuRead(uint16_t addr);
 	void clock();
+	void run(uint32_t nTicks); // As clock() nTicks times, skipping over the ticks where nothing changes
 	void reset();
 
-	double GetOutputSample();
+	// Audio is synthesised in blocks. Every clock since the last block is
+	// turned into samples at this rate, which are appended to vOut.
+	void SetSampleFrequency(uint32_t sample_rate);
+	void EndAudioBlock(std::vector<float>& vOut);
+
+	// The state of every channel. What has been synthesised so far is not
+	// part of it, so loading a state carries on from the sound already made.
+	void saveState(StateWriter& state) const;
+	void loadState(StateReader& state);
 
 	uint16_t pulse1_visual = 0;
 	uint16_t pulse2_visual = 0;
@@ -24,10 +36,28 @@ public:
 private:
 	uint32_t frame_clock_counter = 0;
 	uint32_t clock_counter = 0;
-	bool bUseRawMode = false;
 
-	static uint8_t length_table[];
+	static const uint8_t length_table[];
+
+	// How each channel manipulates its sequence when the sequencer's timer expires
+	struct pulse_step
+	{
+		void operator()(uint32_t& s) const
+		{
+			// Shift right by 1 bit, wrapping around
+			s = ((s & 0x0001) << 7) | ((s & 0x00FE) >> 1);
+		}
+	};
 
+	struct noise_step
+	{
+		void operator()(uint32_t& s) const
+		{
+			s = (((s & 0x0001) ^ ((s & 0x0002) >> 1)) << 14) | ((s & 0x7FFF) >> 1);
+		}
+	};
+
+	template <typename Step>
 	struct sequencer
 	{
 		uint32_t sequence = 0x00000000;
@@ -36,8 +66,7 @@ private:
 		uint16_t reload = 0x0000;
 		uint8_t output = 0x00;
 
-		// Lambda function to manipulate the sequence as required by the owner of the sequencer module
-		uint8_t clock(bool bEnable, std::function<void(uint32_t& s)> funcManip)
+		uint8_t clock(bool bEnable)
 		{
 			if (bEnable)
 			{
@@ -45,12 +74,48 @@ private:
 				if (timer == 0xFFFF)
 				{
 					timer = reload;
-					funcManip(sequence);
+					Step()(sequence);
 					output = sequence & 0x00000001;
 				}
 			}
 			return output;
 		}
+
+		// As clock(true) up to nClocks times, but only doing any work when
+		// the timer expires. Stops on the clock the output changes, returning
+		// how many clocks were taken, or nClocks if it never changed.
+		uint32_t advance(uint32_t nClocks)
+		{
+			uint32_t nTaken = 0;
+			while (nClocks - nTaken > timer)
+			{
+				nTaken += timer + 1;
+				timer = reload;
+				Step()(sequence);
+
+				if ((sequence & 0x00000001) != output)
+				{
+					output = sequence & 0x00000001;
+					return nTaken;
+				}
+			}
+
+			timer -= (uint16_t)(nClocks - nTaken);
+			return nClocks;
+		}
+
+		// A field at a time, as the padding after output is never set
+		void saveState(StateWriter& state) const
+		{
+			state.Write(sequence); state.Write(new_sequence);
+			state.Write(timer); state.Write(reload); state.Write(output);
+		}
+
+		void loadState(StateReader& state)
+		{
+			state.Read(sequence); state.Read(new_sequence);
+			state.Read(timer); state.Read(reload); state.Read(output);
+		}
 	};
 
 	struct lengthcounter
@@ -65,6 +130,9 @@ private:
 					counter--;
 			return counter;
 		}
+
+		void saveState(StateWriter& state) const { state.Write(counter); }
+		void loadState(StateReader& state) { state.Read(counter); }
 	};
 
 	struct envelope
@@ -114,44 +182,21 @@ private:
 		uint16_t volume = 0;
 		uint16_t output = 0;
 		uint16_t decay_count = 0;
-	};
-
 
-	struct oscpulse
-	{
-		double frequency = 0;
-		double dutycycle = 0;
-		double amplitude = 1;
-		double pi = 3.14159;
-		double harmonics = 20;
-
-		double sample(double t)
+		void saveState(StateWriter& state) const
 		{
-			double a = 0;
-			double b = 0;
-			double p = dutycycle * 2.0 * pi;
-
-			auto approxsin = [](double t)
-				{
-					double j = t * 0.15915;
-					j = j - (int)j;
-					return 20.785 * j * (j - 0.5) * (j - 1.0);
-				};
-
-			for (double n = 1; n < harmonics; n++)
-			{
-				double c = n * frequency * 2.0 * pi * t;
-				a += -approxsin(c) / n;
-				b += -approxsin(c - p * n) / n;
-
-				//a += -sin(c) / n;
-				//b += -sin(c - p * n) / n;
-			}
+			state.Write(start); state.Write(disable); state.Write(divider_count);
+			state.Write(volume); state.Write(output); state.Write(decay_count);
+		}
 
-			return (2.0 * amplitude / pi) * (a - b);
+		void loadState(StateReader& state)
+		{
+			state.Read(start); state.Read(disable); state.Read(divider_count);
+			state.Read(volume); state.Read(output); state.Read(decay_count);
 		}
 	};
 
+
 	struct sweeper
 	{
 		bool enabled = false;
@@ -206,17 +251,39 @@ private:
 
 			return changed;
 		}
+
+		// A field at a time, as the padding after mute is never set
+		void saveState(StateWriter& state) const
+		{
+			state.Write(enabled); state.Write(down); state.Write(reload); state.Write(shift);
+			state.Write(timer); state.Write(period); state.Write(change); state.Write(mute);
+		}
+
+		void loadState(StateReader& state)
+		{
+			state.Read(enabled); state.Read(down); state.Read(reload); state.Read(shift);
+			state.Read(timer); state.Read(period); state.Read(change); state.Read(mute);
+		}
 	};
 
-	double dGlobalTime = 0.0;
+	// Output, as steps in the level of each channel
+	BlipBuffer blip;
+	uint32_t block_start = 0;
+	void UpdateLevel(uint8_t& level, uint8_t new_level, uint32_t clock);
+	void ChannelVolumes(uint8_t& pulse1, uint8_t& pulse2, uint8_t& noise) const;
+	void TrackChanges();
+
+	// Bulk execution, for stretches of APU steps in which the frame
+	// sequencer does nothing, and so only the sequencers change
+	uint32_t QuietSteps() const;
+	template <typename Step>
+	void RunChannel(sequencer<Step>& seq, bool bEnable, uint8_t volume, uint8_t& level, uint32_t nSteps);
 
 	// Square Wave Pulse Channel 1
 	bool pulse1_enable = false;
 	bool pulse1_halt = false;
-	double pulse1_sample = 0.0;
-	double pulse1_output = 0.0;
-	sequencer pulse1_seq;
-	oscpulse pulse1_osc;
+	uint8_t pulse1_level = 0;
+	sequencer<pulse_step> pulse1_seq;
 	envelope pulse1_env;
 	lengthcounter pulse1_lc;
 	sweeper pulse1_sweep;
@@ -224,10 +291,8 @@ private:
 	// Square Wave Pulse Channel 2
 	bool pulse2_enable = false;
 	bool pulse2_halt = false;
-	double pulse2_sample = 0.0;
-	double pulse2_output = 0.0;
-	sequencer pulse2_seq;
-	oscpulse pulse2_osc;
+	uint8_t pulse2_level = 0;
+	sequencer<pulse_step> pulse2_seq;
 	envelope pulse2_env;
 	lengthcounter pulse2_lc;
 	sweeper pulse2_sweep;
@@ -237,9 +302,8 @@ private:
 	bool noise_halt = false;
 	envelope noise_env;
 	lengthcounter noise_lc;
-	sequencer noise_seq;
-	double noise_sample = 0;
-	double noise_output = 0;
+	sequencer<noise_step> noise_seq;
+	uint8_t noise_level = 0;
 
 };
 
@@ -1,80 +1,94 @@
+#include <cstring>
+
+// The scanline compositor has vector paths for x86. SSE2 is always there on
+// x64, AVX2 must be asked for with /arch:AVX2 or -mavx2.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PPU_SIMD_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PPU_SIMD_SSE2
+#endif
+
 #include "olc2C02.h"
 
 olc2C02::olc2C02()
 {
-	palScreen[0x00] = olc::Pixel(84, 84, 84);
-	palScreen[0x01] = olc::Pixel(0, 30, 116);
-	palScreen[0x02] = olc::Pixel(8, 16, 144);
-	palScreen[0x03] = olc::Pixel(48, 0, 136);
-	palScreen[0x04] = olc::Pixel(68, 0, 100);
-	palScreen[0x05] = olc::Pixel(92, 0, 48);
-	palScreen[0x06] = olc::Pixel(84, 4, 0);
-	palScreen[0x07] = olc::Pixel(60, 24, 0);
-	palScreen[0x08] = olc::Pixel(32, 42, 0);
-	palScreen[0x09] = olc::Pixel(8, 58, 0);
-	palScreen[0x0A] = olc::Pixel(0, 64, 0);
-	palScreen[0x0B] = olc::Pixel(0, 60, 0);
-	palScreen[0x0C] = olc::Pixel(0, 50, 60);
-	palScreen[0x0D] = olc::Pixel(0, 0, 0);
-	palScreen[0x0E] = olc::Pixel(0, 0, 0);
-	palScreen[0x0F] = olc::Pixel(0, 0, 0);
-
-	palScreen[0x10] = olc::Pixel(152, 150, 152);
-	palScreen[0x11] = olc::Pixel(8, 76, 196);
-	palScreen[0x12] = olc::Pixel(48, 50, 236);
-	palScreen[0x13] = olc::Pixel(92, 30, 228);
-	palScreen[0x14] = olc::Pixel(136, 20, 176);
-	palScreen[0x15] = olc::Pixel(160, 20, 100);
-	palScreen[0x16] = olc::Pixel(152, 34, 32);
-	palScreen[0x17] = olc::Pixel(120, 60, 0);
-	palScreen[0x18] = olc::Pixel(84, 90, 0);
-	palScreen[0x19] = olc::Pixel(40, 114, 0);
-	palScreen[0x1A] = olc::Pixel(8, 124, 0);
-	palScreen[0x1B] = olc::Pixel(0, 118, 40);
-	palScreen[0x1C] = olc::Pixel(0, 102, 120);
-	palScreen[0x1D] = olc::Pixel(0, 0, 0);
-	palScreen[0x1E] = olc::Pixel(0, 0, 0);
-	palScreen[0x1F] = olc::Pixel(0, 0, 0);
-
-	palScreen[0x20] = olc::Pixel(236, 238, 236);
-	palScreen[0x21] = olc::Pixel(76, 154, 236);
-	palScreen[0x22] = olc::Pixel(120, 124, 236);
-	palScreen[0x23] = olc::Pixel(176, 98, 236);
-	palScreen[0x24] = olc::Pixel(228, 84, 236);
-	palScreen[0x25] = olc::Pixel(236, 88, 180);
-	palScreen[0x26] = olc::Pixel(236, 106, 100);
-	palScreen[0x27] = olc::Pixel(212, 136, 32);
-	palScreen[0x28] = olc::Pixel(160, 170, 0);
-	palScreen[0x29] = olc::Pixel(116, 196, 0);
-	palScreen[0x2A] = olc::Pixel(76, 208, 32);
-	palScreen[0x2B] = olc::Pixel(56, 204, 108);
-	palScreen[0x2C] = olc::Pixel(56, 180, 204);
-	palScreen[0x2D] = olc::Pixel(60, 60, 60);
-	palScreen[0x2E] = olc::Pixel(0, 0, 0);
-	palScreen[0x2F] = olc::Pixel(0, 0, 0);
-
-	palScreen[0x30] = olc::Pixel(236, 238, 236);
-	palScreen[0x31] = olc::Pixel(168, 204, 236);
-	palScreen[0x32] = olc::Pixel(188, 188, 236);
-	palScreen[0x33] = olc::Pixel(212, 178, 236);
-	palScreen[0x34] = olc::Pixel(236, 174, 236);
-	palScreen[0x35] = olc::Pixel(236, 174, 212);
-	palScreen[0x36] = olc::Pixel(236, 180, 176);
-	palScreen[0x37] = olc::Pixel(228, 196, 144);
-	palScreen[0x38] = olc::Pixel(204, 210, 120);
-	palScreen[0x39] = olc::Pixel(180, 222, 120);
-	palScreen[0x3A] = olc::Pixel(168, 226, 144);
-	palScreen[0x3B] = olc::Pixel(152, 226, 180);
-	palScreen[0x3C] = olc::Pixel(160, 214, 228);
-	palScreen[0x3D] = olc::Pixel(160, 162, 160);
-	palScreen[0x3E] = olc::Pixel(0, 0, 0);
-	palScreen[0x3F] = olc::Pixel(0, 0, 0);
-
-	sprScreen = new olc::Sprite(256, 240);
-	sprNameTable[0] = new olc::Sprite(256, 240);
-	sprNameTable[1] = new olc::Sprite(256, 240);
-	sprPatternTable[0] = new olc::Sprite(128, 128);
-	sprPatternTable[1] = new olc::Sprite(128, 128);
+	palScreen[0x00] = Pixel(84, 84, 84);
+	palScreen[0x01] = Pixel(0, 30, 116);
+	palScreen[0x02] = Pixel(8, 16, 144);
+	palScreen[0x03] = Pixel(48, 0, 136);
+	palScreen[0x04] = Pixel(68, 0, 100);
+	palScreen[0x05] = Pixel(92, 0, 48);
+	palScreen[0x06] = Pixel(84, 4, 0);
+	palScreen[0x07] = Pixel(60, 24, 0);
+	palScreen[0x08] = Pixel(32, 42, 0);
+	palScreen[0x09] = Pixel(8, 58, 0);
+	palScreen[0x0A] = Pixel(0, 64, 0);
+	palScreen[0x0B] = Pixel(0, 60, 0);
+	palScreen[0x0C] = Pixel(0, 50, 60);
+	palScreen[0x0D] = Pixel(0, 0, 0);
+	palScreen[0x0E] = Pixel(0, 0, 0);
+	palScreen[0x0F] = Pixel(0, 0, 0);
+
+	palScreen[0x10] = Pixel(152, 150, 152);
+	palScreen[0x11] = Pixel(8, 76, 196);
+	palScreen[0x12] = Pixel(48, 50, 236);
+	palScreen[0x13] = Pixel(92, 30, 228);
+	palScreen[0x14] = Pixel(136, 20, 176);
+	palScreen[0x15] = Pixel(160, 20, 100);
+	palScreen[0x16] = Pixel(152, 34, 32);
+	palScreen[0x17] = Pixel(120, 60, 0);
+	palScreen[0x18] = Pixel(84, 90, 0);
+	palScreen[0x19] = Pixel(40, 114, 0);
+	palScreen[0x1A] = Pixel(8, 124, 0);
+	palScreen[0x1B] = Pixel(0, 118, 40);
+	palScreen[0x1C] = Pixel(0, 102, 120);
+	palScreen[0x1D] = Pixel(0, 0, 0);
+	palScreen[0x1E] = Pixel(0, 0, 0);
+	palScreen[0x1F] = Pixel(0, 0, 0);
+
+	palScreen[0x20] = Pixel(236, 238, 236);
+	palScreen[0x21] = Pixel(76, 154, 236);
+	palScreen[0x22] = Pixel(120, 124, 236);
+	palScreen[0x23] = Pixel(176, 98, 236);
+	palScreen[0x24] = Pixel(228, 84, 236);
+	palScreen[0x25] = Pixel(236, 88, 180);
+	palScreen[0x26] = Pixel(236, 106, 100);
+	palScreen[0x27] = Pixel(212, 136, 32);
+	palScreen[0x28] = Pixel(160, 170, 0);
+	palScreen[0x29] = Pixel(116, 196, 0);
+	palScreen[0x2A] = Pixel(76, 208, 32);
+	palScreen[0x2B] = Pixel(56, 204, 108);
+	palScreen[0x2C] = Pixel(56, 180, 204);
+	palScreen[0x2D] = Pixel(60, 60, 60);
+	palScreen[0x2E] = Pixel(0, 0, 0);
+	palScreen[0x2F] = Pixel(0, 0, 0);
+
+	palScreen[0x30] = Pixel(236, 238, 236);
+	palScreen[0x31] = Pixel(168, 204, 236);
+	palScreen[0x32] = Pixel(188, 188, 236);
+	palScreen[0x33] = Pixel(212, 178, 236);
+	palScreen[0x34] = Pixel(236, 174, 236);
+	palScreen[0x35] = Pixel(236, 174, 212);
+	palScreen[0x36] = Pixel(236, 180, 176);
+	palScreen[0x37] = Pixel(228, 196, 144);
+	palScreen[0x38] = Pixel(204, 210, 120);
+	palScreen[0x39] = Pixel(180, 222, 120);
+	palScreen[0x3A] = Pixel(168, 226, 144);
+	palScreen[0x3B] = Pixel(152, 226, 180);
+	palScreen[0x3C] = Pixel(160, 214, 228);
+	palScreen[0x3D] = Pixel(160, 162, 160);
+	palScreen[0x3E] = Pixel(0, 0, 0);
+	palScreen[0x3F] = Pixel(0, 0, 0);
+
+	std::memset(screenIndex, 0x0F, sizeof(screenIndex)); // Black
+	sprScreen = new Sprite(256, 240);
+	sprNameTable[0] = new Sprite(256, 240);
+	sprNameTable[1] = new Sprite(256, 240);
+	sprPatternTable[0] = new Sprite(128, 128);
+	sprPatternTable[1] = new Sprite(128, 128);
 }
 
 olc2C02::~olc2C02()
@@ -221,32 +235,7 @@ uint8_t olc2C02::ppuRead(uint16_t addr, bool rdonly)
 	}
 	else if (addr >= 0x2000 && addr <= 0x3EFF)
 	{
-		addr &= 0x0FFF;
-
-		if (cart->Mirror() == MIRROR::VERTICAL)
-		{
-			// Vertical
-			if (addr >= 0x0000 && addr <= 0x03FF)
-				data = tblName[0][addr & 0x03FF];
-			if (addr >= 0x0400 && addr <= 0x07FF)
-				data = tblName[1][addr & 0x03FF];
-			if (addr >= 0x0800 && addr <= 0x0BFF)
-				data = tblName[0][addr & 0x03FF];
-			if (addr >= 0x0C00 && addr <= 0x0FFF)
-				data = tblName[1][addr & 0x03FF];
-		}
-		else if (cart->Mirror() == MIRROR::HORIZONTAL)
-		{
-			// Horizontal
-			if (addr >= 0x0000 && addr <= 0x03FF)
-				data = tblName[0][addr & 0x03FF];
-			if (addr >= 0x0400 && addr <= 0x07FF)
-				data = tblName[0][addr & 0x03FF];
-			if (addr >= 0x0800 && addr <= 0x0BFF)
-				data = tblName[1][addr & 0x03FF];
-			if (addr >= 0x0C00 && addr <= 0x0FFF)
-				data = tblName[1][addr & 0x03FF];
-		}
+		data = pNameTable[(addr >> 10) & 0x03][addr & 0x03FF];
 	}
 	else if (addr >= 0x3F00 && addr <= 0x3FFF)
 	{
@@ -275,31 +264,7 @@ void olc2C02::ppuWrite(uint16_t addr, uint8_t data)
 	}
 	else if (addr >= 0x2000 && addr <= 0x3EFF)
 	{
-		addr &= 0x0FFF;
-		if (cart->Mirror() == MIRROR::VERTICAL)
-		{
-			// Vertical
-			if (addr >= 0x0000 && addr <= 0x03FF)
-				tblName[0][addr & 0x03FF] = data;
-			if (addr >= 0x0400 && addr <= 0x07FF)
-				tblName[1][addr & 0x03FF] = data;
-			if (addr >= 0x0800 && addr <= 0x0BFF)
-				tblName[0][addr & 0x03FF] = data;
-			if (addr >= 0x0C00 && addr <= 0x0FFF)
-				tblName[1][addr & 0x03FF] = data;
-		}
-		else if (cart->Mirror() == MIRROR::HORIZONTAL)
-		{
-			// Horizontal
-			if (addr >= 0x0000 && addr <= 0x03FF)
-				tblName[0][addr & 0x03FF] = data;
-			if (addr >= 0x0400 && addr <= 0x07FF)
-				tblName[0][addr & 0x03FF] = data;
-			if (addr >= 0x0800 && addr <= 0x0BFF)
-				tblName[1][addr & 0x03FF] = data;
-			if (addr >= 0x0C00 && addr <= 0x0FFF)
-				tblName[1][addr & 0x03FF] = data;
-		}
+		pNameTable[(addr >> 10) & 0x03][addr & 0x03FF] = data;
 	}
 	else if (addr >= 0x3F00 && addr <= 0x3FFF)
 	{
@@ -317,17 +282,61 @@ void olc2C02::ConnectCartridge(const std::shared_ptr<Cartridge>& cartridge)
 	this->cart = cartridge;
 }
 
-olc::Sprite& olc2C02::GetScreen()
+void olc2C02::MapNameTables()
+{
+	switch (cart->Mirror())
+	{
+	case MIRROR::VERTICAL:
+		pNameTable[0] = tblName[0]; pNameTable[1] = tblName[1];
+		pNameTable[2] = tblName[0]; pNameTable[3] = tblName[1];
+		break;
+
+	case MIRROR::ONESCREEN_LO:
+		pNameTable[0] = pNameTable[1] = pNameTable[2] = pNameTable[3] = tblName[0];
+		break;
+
+	case MIRROR::ONESCREEN_HI:
+		pNameTable[0] = pNameTable[1] = pNameTable[2] = pNameTable[3] = tblName[1];
+		break;
+
+	case MIRROR::FOURSCREEN:
+		// The cartridge has the other two nametables' worth of VRAM
+		pNameTable[0] = tblName[0]; pNameTable[1] = tblName[1];
+		pNameTable[2] = cart->ppuVRAM(); pNameTable[3] = cart->ppuVRAM() + 0x0400;
+		break;
+
+	default:
+		pNameTable[0] = tblName[0]; pNameTable[1] = tblName[0];
+		pNameTable[2] = tblName[1]; pNameTable[3] = tblName[1];
+		break;
+	}
+}
+
+const uint8_t* olc2C02::GetScreenIndices() const
+{
+	return screenIndex;
+}
+
+// One table lookup per pixel, with nothing else to get in the way of the
+// compiler unrolling or vectorising it
+void olc2C02::ConvertScreen(const uint8_t* pIndices, Pixel* pOut) const
 {
+	for (int i = 0; i < 256 * 240; i++)
+		pOut[i] = palScreen[pIndices[i] & 0x3F];
+}
+
+olc2C02::Sprite& olc2C02::GetScreen()
+{
+	ConvertScreen(screenIndex, sprScreen->GetData());
 	return *sprScreen;
 }
 
-olc::Sprite& olc2C02::GetNameTable(uint8_t i)
+olc2C02::Sprite& olc2C02::GetNameTable(uint8_t i)
 {
 	return *sprNameTable[i];
 }
 
-olc::Sprite& olc2C02::GetPatternTable(uint8_t i, uint8_t palette)
+olc2C02::Sprite& olc2C02::GetPatternTable(uint8_t i, uint8_t palette)
 {
 	for (uint16_t nTileY = 0; nTileY < 16; nTileY++)
 	{
@@ -358,9 +367,14 @@ olc::Sprite& olc2C02::GetPatternTable(uint8_t i, uint8_t palette)
 	return *sprPatternTable[i];
 }
 
-olc::Pixel& olc2C02::GetColourFromPaletteRam(uint8_t palette, uint8_t pixel)
+olc2C02::Pixel& olc2C02::GetColourFromPaletteRam(uint8_t palette, uint8_t pixel)
 {
-	return palScreen[ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F];
+	return palScreen[GetIndexFromPaletteRam(palette, pixel)];
+}
+
+uint8_t olc2C02::GetIndexFromPaletteRam(uint8_t palette, uint8_t pixel)
+{
+	return ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F;
 }
 
 void olc2C02::reset()
@@ -387,113 +401,831 @@ void olc2C02::reset()
 	odd_frame = false;
 }
 
-void olc2C02::clock()
+void olc2C02::saveState(StateWriter& state, bool bScreen) const
+{
+	// Memory. tblPattern is not included as the cartridge
+	// answers every access to pattern memory.
+	state.Write(tblName);
+	state.Write(tblPalette);
+	state.Write(OAM);
+	state.Write(oam_addr);
+
+	// Registers
+	state.Write(status.reg);
+	state.Write(mask.reg);
+	state.Write(control.reg);
+	state.Write(vram_addr.reg);
+	state.Write(tram_addr.reg);
+	state.Write(fine_x);
+	state.Write(address_latch);
+	state.Write(ppu_data_buffer);
+
+	// Position
+	state.Write(scanline);
+	state.Write(cycle);
+	state.Write(odd_frame);
+	state.Write(frame_complete);
+	state.Write(scanline_trigger);
+
+	// Rendering
+	state.Write(bg_next_tile_id);
+	state.Write(bg_next_tile_attrib);
+	state.Write(bg_next_tile_lsb);
+	state.Write(bg_next_tile_msb);
+	state.Write(bg_shifter_pattern_lo);
+	state.Write(bg_shifter_pattern_hi);
+	state.Write(bg_shifter_attrib_lo);
+	state.Write(bg_shifter_attrib_hi);
+	state.Write(spriteScanline);
+	state.Write(sprite_count);
+	state.Write(sprite_shifter_pattern_lo);
+	state.Write(sprite_shifter_pattern_hi);
+	state.Write(bSpriteZeroHitPossible);
+	state.Write(bSpriteZeroBeingRendered);
+
+	if (bScreen)
+		state.Write(screenIndex);
+}
+
+void olc2C02::loadState(StateReader& state, bool bScreen)
+{
+	state.Read(tblName);
+	state.Read(tblPalette);
+	state.Read(OAM);
+	state.Read(oam_addr);
+
+	state.Read(status.reg);
+	state.Read(mask.reg);
+	state.Read(control.reg);
+	state.Read(vram_addr.reg);
+	state.Read(tram_addr.reg);
+	state.Read(fine_x);
+	state.Read(address_latch);
+	state.Read(ppu_data_buffer);
+
+	state.Read(scanline);
+	state.Read(cycle);
+	state.Read(odd_frame);
+	state.Read(frame_complete);
+	state.Read(scanline_trigger);
+
+	state.Read(bg_next_tile_id);
+	state.Read(bg_next_tile_attrib);
+	state.Read(bg_next_tile_lsb);
+	state.Read(bg_next_tile_msb);
+	state.Read(bg_shifter_pattern_lo);
+	state.Read(bg_shifter_pattern_hi);
+	state.Read(bg_shifter_attrib_lo);
+	state.Read(bg_shifter_attrib_hi);
+	state.Read(spriteScanline);
+	state.Read(sprite_count);
+	state.Read(sprite_shifter_pattern_lo);
+	state.Read(sprite_shifter_pattern_hi);
+	state.Read(bSpriteZeroHitPossible);
+	state.Read(bSpriteZeroBeingRendered);
+
+	if (bScreen)
+		state.Read(screenIndex);
+}
+
+uint32_t olc2C02::DotsUntil(int16_t nScanline, int16_t nCycle) const
+{
+	// Flatten positions into a dot index from the start of the pre-render line
+	const int32_t nDotsPerFrame = 262 * 341;
+	const int32_t nSkipDot = 341; // Scanline 0, cycle 0
+	int32_t nFrom = (scanline + 1) * 341 + cycle;
+	int32_t nTo = (nScanline + 1) * 341 + nCycle;
+
+	int32_t nDots = nTo - nFrom;
+	if (nDots < 0) nDots += nDotsPerFrame;
+
+	// Does the path pass over the dot which may be skipped on odd frames?
+	bool bCrossesSkip = (nFrom <= nTo) ? (nFrom <= nSkipDot && nSkipDot < nTo) : (nSkipDot >= nFrom || nSkipDot < nTo);
+	if (bCrossesSkip && nDots > 0) nDots--;
+
+	return (uint32_t)nDots;
+}
+
+uint32_t olc2C02::DotsUntilA12() const
+{
+	if (!(mask.render_background || mask.render_sprites))
+		return UINT32_MAX;
+
+	// Background tiles are fetched up to dot 256 and again from 321, sprites
+	// in between. A12 rises on the first fetch from the upper table after
+	// fetches from the lower one: the first sprite's pattern fetch when the
+	// sprites use it, the first background one for the next line when the
+	// background does. 8x16 sprites pick a table per sprite, and unused
+	// slots fetch tile $FF from the upper one, so they count as upper.
+	int16_t nEdge;
+	if (!control.pattern_background && (control.pattern_sprite || control.sprite_size))
+		nEdge = 260;
+	else if (control.pattern_background && (!control.pattern_sprite || control.sprite_size))
+		nEdge = 324;
+	else
+		return UINT32_MAX;
+
+	// Only the pre-render line and visible lines fetch patterns
+	int16_t nLine = cycle > nEdge ? scanline + 1 : scanline;
+	if (nLine >= 240)
+		nLine = -1;
+
+	// DotsUntil() assumes the odd frame dot is skipped. With rendering on
+	// it is known whether it will be: it is this frame's dot if the PPU has
+	// not yet passed it, otherwise the next frame's, which flips odd_frame.
+	const int32_t nSkipDot = 341;
+	int32_t nFrom = (scanline + 1) * 341 + cycle;
+	int32_t nTo = (nLine + 1) * 341 + nEdge;
+	bool bCrossesSkip = (nFrom <= nTo) ? (nFrom <= nSkipDot && nSkipDot < nTo) : (nSkipDot >= nFrom || nSkipDot < nTo);
+	bool bSkipped = nFrom <= nSkipDot ? odd_frame : !odd_frame;
+
+	uint32_t nDots = DotsUntil(nLine, nEdge);
+	if (bCrossesSkip && !bSkipped)
+		nDots++;
+
+	return nDots;
+}
+
+void olc2C02::IncrementScrollX()
 {
-		auto IncrementScrollX = [&]()
+	if (mask.render_background || mask.render_sprites)
+	{
+		if (vram_addr.coarse_x == 31)
+		{
+			vram_addr.coarse_x = 0;
+			vram_addr.nametable_x = ~vram_addr.nametable_x;
+		}
+		else
+		{
+			vram_addr.coarse_x++;
+		}
+
+	}
+}
+
+void olc2C02::IncrementScrollY()
+{
+	if (mask.render_background || mask.render_sprites)
+	{
+		if (vram_addr.fine_y < 7)
+		{
+			vram_addr.fine_y++;
+		}
+		else
+		{
+			vram_addr.fine_y = 0;
+
+			if (vram_addr.coarse_y == 29)
 			{
-				if (mask.render_background || mask.render_sprites)
-				{
-					if (vram_addr.coarse_x == 31)
-					{
-						vram_addr.coarse_x = 0;
-						vram_addr.nametable_x = ~vram_addr.nametable_x;
-					}
-					else
-					{
-						vram_addr.coarse_x++;
-					}
+				vram_addr.coarse_y = 0;
+				vram_addr.nametable_y = ~vram_addr.nametable_y;
+			}
+			else if (vram_addr.coarse_y == 31)
+			{
+				vram_addr.coarse_y = 0;
+			}
+			else
+			{
+				vram_addr.coarse_y++;
+			}
+		}
+	}
+}
 
-				}
-			};
+void olc2C02::TransferAddressX()
+{
+	if (mask.render_background || mask.render_sprites)
+	{
+		vram_addr.nametable_x = tram_addr.nametable_x;
+		vram_addr.coarse_x = tram_addr.coarse_x;
+	}
+}
+
+void olc2C02::TransferAddressY()
+{
+	if (mask.render_background || mask.render_sprites)
+	{
+		vram_addr.fine_y = tram_addr.fine_y;
+		vram_addr.nametable_y = tram_addr.nametable_y;
+		vram_addr.coarse_y = tram_addr.coarse_y;
+	}
+}
+
+void olc2C02::LoadBackgroundShifters()
+{
+	bg_shifter_pattern_lo = (bg_shifter_pattern_lo & 0xFF00) | bg_next_tile_lsb;
+	bg_shifter_pattern_hi = (bg_shifter_pattern_hi & 0xFF00) | bg_next_tile_msb;
+
+	bg_shifter_attrib_lo = (bg_shifter_attrib_lo & 0xFF00) | ((bg_next_tile_attrib & 0b01) ? 0xFF : 0x00);
+	bg_shifter_attrib_hi = (bg_shifter_attrib_hi & 0xFF00) | ((bg_next_tile_attrib & 0b10) ? 0xFF : 0x00);
+
+}
+
+void olc2C02::UpdateShifters()
+{
+	if (mask.render_background)
+	{
+		// Shifting background tile pattern row
+		bg_shifter_pattern_lo <<= 1;
+		bg_shifter_pattern_hi <<= 1;
+
+		// Shifting palette attributes by 1
+		bg_shifter_attrib_lo <<= 1;
+		bg_shifter_attrib_hi <<= 1;
+	}
 
-		auto IncrementScrollY = [&]()
+	if (mask.render_sprites && cycle >= 1 && cycle < 258)
+	{
+		for (int i = 0; i < sprite_count; i++)
+		{
+			if (spriteScanline[i].x > 0)
 			{
-				if (mask.render_background || mask.render_sprites)
+				spriteScanline[i].x--;
+			}
+			else
+			{
+				sprite_shifter_pattern_lo[i] <<= 1;
+				sprite_shifter_pattern_hi[i] <<= 1;
+			}
+		}
+	}
+}
+
+// Simplified for understanding. The real NES does not do it like this.
+void olc2C02::EvaluateSprites()
+{
+	// PPU loads sprite information succesively during the region that background tiles are not being drawn.
+	// This implementation does all sprite evaluation in one go.
+
+	std::memset(spriteScanline, 0xFF, 8 * sizeof(sObjectAttributeEntry));
+
+	sprite_count = 0;
+
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		sprite_shifter_pattern_hi[i] = 0;
+		sprite_shifter_pattern_lo[i] = 0;
+	}
+
+	uint8_t nOAMEntry = 0;
+
+	bSpriteZeroHitPossible = false;
+
+	while (nOAMEntry < 64 && sprite_count < 9)
+	{
+		int16_t diff = ((int16_t)scanline - (int16_t)OAM[nOAMEntry].y);
+
+		if (diff >= 0 && diff < (control.sprite_size ? 16 : 8))
+		{
+			if (sprite_count < 8)
+			{
+				if (nOAMEntry == 0)
 				{
-					if (vram_addr.fine_y < 7)
-					{
-						vram_addr.fine_y++;
-					}
-					else
-					{
-						vram_addr.fine_y = 0;
-
-						if (vram_addr.coarse_y == 29)
-						{
-							vram_addr.coarse_y = 0;
-							vram_addr.nametable_y = ~vram_addr.nametable_y;
-						}
-						else if (vram_addr.coarse_y == 31)
-						{
-							vram_addr.coarse_y = 0;
-						}
-						else
-						{
-							vram_addr.coarse_y++;
-						}
-					}
+					bSpriteZeroHitPossible = true;
 				}
-			};
 
-		auto TransferAddressX = [&]()
+				memcpy(&spriteScanline[sprite_count], &OAM[nOAMEntry], sizeof(sObjectAttributeEntry));
+				sprite_count++;
+			}
+		}
+
+		nOAMEntry++;
+	}
+
+	status.sprite_overflow = (sprite_count > 8);
+}
+
+void olc2C02::FetchSprites()
+{
+	if (sprite_count == 0)
+		return;
+
+	const TileCache::sRow* const* pTiles = cart->ppuMapTiles();
+
+	for (uint8_t i = 0; i < sprite_count; i++)
+	{
+		uint8_t sprite_pattern_bits_lo, sprite_pattern_bits_hi;
+		uint16_t sprite_pattern_addr_lo;
+
+		if (!control.sprite_size)
+		{
+			if (!(spriteScanline[i].attribute & 0x80))
+			{
+				sprite_pattern_addr_lo =
+					(control.pattern_sprite << 12)
+					| (spriteScanline[i].id << 4)
+					| (scanline - spriteScanline[i].y);
+			}
+			else
 			{
-				if (mask.render_background || mask.render_sprites)
+				sprite_pattern_addr_lo =
+					(control.pattern_sprite << 12)
+					| (spriteScanline[i].id << 4)
+					| (7 - (scanline - spriteScanline[i].y));
+			}
+		}
+		else
+		{
+			// 8x16 Sprite Mode - The sprite attribute determines the pattern table
+			if (!(spriteScanline[i].attribute & 0x80))
+			{
+				// Sprite is NOT flipped vertically, i.e. normal
+				if (scanline - spriteScanline[i].y < 8)
 				{
-					vram_addr.nametable_x = tram_addr.nametable_x;
-					vram_addr.coarse_x = tram_addr.coarse_x;
+					// Reading Top half Tile
+					sprite_pattern_addr_lo =
+						((spriteScanline[i].id & 0x01) << 12)  // Which Pattern Table? 0KB or 4KB offset
+						| ((spriteScanline[i].id & 0xFE) << 4)  // Which Cell? Tile ID * 16 (16 bytes per tile)
+						| ((scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
 				}
-			};
-
-		auto TransferAddressY = [&]()
+				else
+				{
+					// Reading Bottom Half Tile
+					sprite_pattern_addr_lo =
+						((spriteScanline[i].id & 0x01) << 12)  // Which Pattern Table? 0KB or 4KB offset
+						| (((spriteScanline[i].id & 0xFE) + 1) << 4)  // Which Cell? Tile ID * 16 (16 bytes per tile)
+						| ((scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
+				}
+			}
+			else
 			{
-				if (mask.render_background || mask.render_sprites)
+				// Sprite is flipped vertically, i.e. upside down
+				if (scanline - spriteScanline[i].y < 8)
 				{
-					vram_addr.fine_y = tram_addr.fine_y;
-					vram_addr.nametable_y = tram_addr.nametable_y;
-					vram_addr.coarse_y = tram_addr.coarse_y;
+					// Reading Top half Tile
+					sprite_pattern_addr_lo =
+						((spriteScanline[i].id & 0x01) << 12)    // Which Pattern Table? 0KB or 4KB offset
+						| (((spriteScanline[i].id & 0xFE) + 1) << 4)    // Which Cell? Tile ID * 16 (16 bytes per tile)
+						| (7 - (scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
 				}
-			};
+				else
+				{
+					// Reading Bottom Half Tile
+					sprite_pattern_addr_lo =
+						((spriteScanline[i].id & 0x01) << 12)    // Which Pattern Table? 0KB or 4KB offset
+						| ((spriteScanline[i].id & 0xFE) << 4)    // Which Cell? Tile ID * 16 (16 bytes per tile)
+						| (7 - (scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
+				}
+			}
+		}
 
-		auto LoadBackgroundShifters = [&]()
+		bool bFlipped = spriteScanline[i].attribute & 0x40;
+		if ((sprite_pattern_addr_lo & 0xE008) == 0)
+		{
+			// The row's planes, already mirrored if the sprite is flipped horizontally
+			const TileCache::sRow& row = pTiles[sprite_pattern_addr_lo >> 10][TileCache::RowIndex(sprite_pattern_addr_lo)];
+			sprite_pattern_bits_lo = bFlipped ? row.lo_flipped : row.lo;
+			sprite_pattern_bits_hi = bFlipped ? row.hi_flipped : row.hi;
+		}
+		else
+		{
+			// A sprite evaluated for another line, or another size, is not
+			// on a row of its tile, and is fetched from wherever it points
+			sprite_pattern_bits_lo = ppuRead(sprite_pattern_addr_lo);
+			sprite_pattern_bits_hi = ppuRead(sprite_pattern_addr_lo + 8);
+			if (bFlipped)
 			{
-				bg_shifter_pattern_lo = (bg_shifter_pattern_lo & 0xFF00) | bg_next_tile_lsb;
-				bg_shifter_pattern_hi = (bg_shifter_pattern_hi & 0xFF00) | bg_next_tile_msb;
+				sprite_pattern_bits_lo = TileCache::Flip(sprite_pattern_bits_lo);
+				sprite_pattern_bits_hi = TileCache::Flip(sprite_pattern_bits_hi);
+			}
+		}
+
+		// Finally! We can load the pattern into our sprite shift registers
+		// ready for rendering on the next scanline
+		sprite_shifter_pattern_lo[i] = sprite_pattern_bits_lo;
+		sprite_shifter_pattern_hi[i] = sprite_pattern_bits_hi;
+	}
+}
+
+// Combine the background and foreground pixels at the current dot into the
+// pixel and palette to draw, detecting sprite zero hits along the way
+void olc2C02::ComposePixel(uint8_t& pixel, uint8_t& palette)
+{
+	uint8_t bg_pixel = 0x00;
+	uint8_t bg_palette = 0x00;
+
+	if (mask.render_background)
+	{
+		uint16_t bit_mux = 0x8000 >> fine_x;
+
+		uint8_t p0_pixel = (bg_shifter_pattern_lo & bit_mux) > 0;
+		uint8_t p1_pixel = (bg_shifter_pattern_hi & bit_mux) > 0;
+
+		bg_pixel = (p1_pixel << 1) | p0_pixel;
+
+		uint8_t bg_pal0 = (bg_shifter_attrib_lo & bit_mux) > 0;
+		uint8_t bg_pal1 = (bg_shifter_attrib_hi & bit_mux) > 0;
+		bg_palette = (bg_pal1 << 1) | bg_pal0;
+	}
 
-				bg_shifter_attrib_lo = (bg_shifter_attrib_lo & 0xFF00) | ((bg_next_tile_attrib & 0b01) ? 0xFF : 0x00);
-				bg_shifter_attrib_hi = (bg_shifter_attrib_hi & 0xFF00) | ((bg_next_tile_attrib & 0b10) ? 0xFF : 0x00);
+	uint8_t fg_pixel = 0x00;
+	uint8_t fg_palette = 0x00;
+	uint8_t fg_priority = 0x00;
 
-			};
+	if (mask.render_sprites)
+	{
+		bSpriteZeroBeingRendered = false;
 
-		auto UpdateShifters = [&]()
+		for (uint8_t i = 0; i < sprite_count; i++)
+		{
+			if (spriteScanline[i].x == 0)
 			{
-				if (mask.render_background)
-				{
-					// Shifting background tile pattern row
-					bg_shifter_pattern_lo <<= 1;
-					bg_shifter_pattern_hi <<= 1;
+				uint8_t fg_pixel_lo = (sprite_shifter_pattern_lo[i] & 0x80) > 0;
+				uint8_t fg_pixel_hi = (sprite_shifter_pattern_hi[i] & 0x80) > 0;
+				fg_pixel = (fg_pixel_hi << 1) | fg_pixel_lo;
+
+				fg_palette = (spriteScanline[i].attribute & 0x03) + 0x04;
+				fg_priority = (spriteScanline[i].attribute & 0x20) == 0;
 
-					// Shifting palette attributes by 1
-					bg_shifter_attrib_lo <<= 1;
-					bg_shifter_attrib_hi <<= 1;
+				if (fg_pixel != 0)
+				{
+					if (i == 0)
+					{
+						bSpriteZeroBeingRendered = true;
+					}
+					break;
 				}
+			}
+		}
+	}
 
-				if (mask.render_sprites && cycle >= 1 && cycle < 258)
+	if (bg_pixel == 0 && fg_pixel == 0)
+	{
+		pixel = 0x00;
+		palette = 0x00;
+	}
+	else if (bg_pixel == 0 && fg_pixel > 0)
+	{
+		pixel = fg_pixel;
+		palette = fg_palette;
+	}
+	else if (bg_pixel > 0 && fg_pixel == 0)
+	{
+		pixel = bg_pixel;
+		palette = bg_palette;
+	}
+	else if (bg_pixel > 0 && fg_pixel > 0)
+	{
+		if (fg_priority)
+		{
+			pixel = fg_pixel;
+			palette = fg_palette;
+		}
+		else
+		{
+			pixel = bg_pixel;
+			palette = bg_palette;
+		}
+
+		if (bSpriteZeroHitPossible && bSpriteZeroBeingRendered)
+		{
+			if (mask.render_background & mask.render_sprites)
+			{
+				if (~(mask.render_background_left | mask.render_sprites_left))
 				{
-					for (int i = 0; i < sprite_count; i++)
+					if (cycle >= 9 && cycle < 258)
 					{
-						if (spriteScanline[i].x > 0)
-						{
-							spriteScanline[i].x--;
-						}
-						else
-						{
-							sprite_shifter_pattern_lo[i] <<= 1;
-							sprite_shifter_pattern_hi[i] <<= 1;
-						}
+						status.sprite_zero_hit = 1;
 					}
 				}
-			};
+				else
+				{
+					if (cycle >= 1 && cycle < 258)
+					{
+						status.sprite_zero_hit = 1;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Scanline Renderer
+// When the PPU is to be run for many dots with nothing outside of it changing
+// in the meantime, whole scanlines can be drawn in one go. This does exactly
+// what clock() would do for every dot of the line, but everything it needs
+// from the rest of the system is looked up once beforehand, and dots which
+// can not change anything are passed over. Partial lines, and the pre-render
+// line, are simply clocked a dot at a time.
+void olc2C02::run(uint32_t nDots)
+{
+	bool bPrepared = false;
+
+	while (nDots > 0)
+	{
+		bool bRendering = mask.render_background || mask.render_sprites;
+		uint32_t nLineDots = (scanline == 0 && odd_frame && bRendering) ? 340 : 341;
+
+		if (cycle == 0 && scanline >= 0 && nDots >= nLineDots)
+		{
+			if (!bPrepared)
+			{
+				PrepareScanlines();
+				bPrepared = true;
+			}
+
+			if (scanline < 240)
+				RenderScanline();
+			else
+				IdleScanline();
+
+			nDots -= nLineDots;
+		}
+		else
+		{
+			clock();
+			nDots--;
+		}
+	}
+}
+
+void olc2C02::PrepareScanlines()
+{
+	// Pattern memory banks, decoded
+	pLineTiles = cart->ppuMapTiles();
+
+	// And the colour of every palette entry
+	for (uint8_t i = 0; i < 32; i++)
+		lineIndex[i] = GetIndexFromPaletteRam(i >> 2, i & 0x03);
+}
+
+// The background fetches of the dot renderer, reading memory directly
+void olc2C02::FetchBackground()
+{
+	switch ((cycle - 1) % 8)
+	{
+	case 0:
+		LoadBackgroundShifters();
+		bg_next_tile_id = pNameTable[vram_addr.nametable_y * 2 + vram_addr.nametable_x][vram_addr.reg & 0x03FF];
+		break;
+
+	case 2:
+		bg_next_tile_attrib = pNameTable[vram_addr.nametable_y * 2 + vram_addr.nametable_x][0x03C0
+			| ((vram_addr.coarse_y >> 2) << 3)
+			| (vram_addr.coarse_x >> 2)];
+		if (vram_addr.coarse_y & 0x02) bg_next_tile_attrib >>= 4;
+		if (vram_addr.coarse_x & 0x02) bg_next_tile_attrib >>= 2;
+		bg_next_tile_attrib &= 0x03;
+		break;
+
+	case 4:
+	{
+		// The whole row is found at once, and kept for the high plane
+		uint16_t addr = (control.pattern_background << 12)
+			+ ((uint16_t)bg_next_tile_id << 4)
+			+ (vram_addr.fine_y);
+		pLineTileRow = &pLineTiles[addr >> 10][TileCache::RowIndex(addr)];
+		bg_next_tile_lsb = pLineTileRow->lo;
+		break;
+	}
+
+	case 6:
+		bg_next_tile_msb = pLineTileRow->hi;
+		break;
+
+	case 7:
+		IncrementScrollX();
+		break;
+	}
+}
+
+// A whole visible scanline, from dot 0 to dot 340
+void olc2C02::RenderScanline()
+{
+	// Dot 0 is idle, and skipped entirely on odd frames. The background
+	// for the line is the two tiles already in the shifters, followed by
+	// each tile fetched as it is drawn, decoded into a byte per pixel as
+	// the compositor takes them. There is room for the sprites which hang
+	// off the right hand edge, and whole vectors read from any offset.
+	alignas(32) uint8_t bg[34 * 8 + 32] = { 0 };
+	bool bBackground = mask.render_background;
+	if (bBackground)
+	{
+		for (int x = 0; x < 16; x++)
+		{
+			uint16_t bit = 0x8000 >> x;
+			bg[x] = ((bg_shifter_pattern_lo & bit) ? 0x01 : 0)
+				| ((bg_shifter_pattern_hi & bit) ? 0x02 : 0)
+				| ((bg_shifter_attrib_lo & bit) ? 0x04 : 0)
+				| ((bg_shifter_attrib_hi & bit) ? 0x08 : 0);
+		}
+	}
+
+	for (int nTile = 0; nTile < 32; nTile++)
+	{
+		for (cycle = nTile * 8 + 3; cycle <= nTile * 8 + 8; cycle++)
+			FetchBackground();
+
+		if (nTile == 31)
+			IncrementScrollY();
+
+		// The fetched row's pixels, with the palette in every one
+		if (bBackground)
+		{
+			uint64_t row;
+			memcpy(&row, pLineTileRow->pixels, 8);
+			row |= (uint64_t)(bg_next_tile_attrib << 2) * 0x0101010101010101ULL;
+			memcpy(&bg[(nTile + 2) * 8], &row, 8);
+		}
+
+		// Loads the shifters and fetches the next tile id, the last
+		// time on dot 257
+		cycle = nTile * 8 + 9;
+		FetchBackground();
+	}
+
+	// The shifters are not clocked above. Sprite ones are about to be
+	// cleared, and background ones shifted clean before the next line.
+	uint8_t index[256];
+	if (ComposeScanline(bg, index))
+		status.sprite_zero_hit = 1;
+
+	uint8_t* pLine = &screenIndex[scanline * 256];
+	for (int x = 0; x < 256; x++)
+		pLine[x] = lineIndex[index[x]];
+
+	// The rest of dot 257, where the sprites for the next line are evaluated
+	TransferAddressX();
+	EvaluateSprites();
+
+	// Nothing happens until the first two tiles of the next line are fetched
+	for (cycle = 321; cycle < 338; cycle++)
+	{
+		UpdateShifters();
+		FetchBackground();
+	}
+
+	// Then the unused nametable fetches and the sprite patterns
+	bg_next_tile_id = pNameTable[vram_addr.nametable_y * 2 + vram_addr.nametable_x][vram_addr.reg & 0x03FF];
+	cycle = 340;
+	FetchSprites();
+
+	// The last dot does not draw, but leaves the sprite zero state as it finds it
+	uint8_t pixel = 0x00;
+	uint8_t palette = 0x00;
+	ComposePixel(pixel, palette);
+
+	cycle = 0;
+	scanline++;
+}
+
+// Scanline Compositor
+// With a whole line of background tiles and sprites to hand, pixels can be
+// combined many at a time rather than a dot at a time, with masks taking the
+// place of the branches in ComposePixel(). Every pixel is first decoded into
+// a byte of its own:
+//
+//   Background 0000 PPpp - Palette and pixel, transparent where pp is zero
+//   Sprite     ZB01 PPpp - Sprite zero, behind background, palette 4-7 and
+//                          pixel, or zero where no sprite is opaque
+//
+// which are then merged into the palette index of each pixel on the line.
+
+#ifdef PPU_SIMD_SSE2
+// Two bytes of a bit plane, each spread across 8 bytes, MSB first, as 0xFF
+// where the bit is set
+static inline __m128i ExpandPlane(uint8_t a, uint8_t b)
+{
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	__m128i v = _mm_cvtsi32_si128(a | (b << 8));
+	v = _mm_unpacklo_epi8(v, v);
+	v = _mm_unpacklo_epi16(v, v);
+	v = _mm_unpacklo_epi32(v, v);
+	return _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+}
+#endif
+
+bool olc2C02::ComposeScanline(const uint8_t* bg, uint8_t* pIndex)
+{
+	// Room for the sprites which hang off the right hand edge, and whole
+	// vectors read from any offset
+	alignas(32) uint8_t fg[256 + 32] = { 0 };
+
+	if (mask.render_sprites)
+	{
+		// Lowest priority first, so each sprite is drawn over by those
+		// which take priority over it
+		for (int i = sprite_count - 1; i >= 0; i--)
+		{
+			uint8_t tag = 0x10 | ((spriteScanline[i].attribute & 0x03) << 2);
+			if (spriteScanline[i].attribute & 0x20) tag |= 0x40;
+			if (i == 0 && bSpriteZeroHitPossible) tag |= 0x80;
+
+			uint8_t* p = &fg[spriteScanline[i].x];
+#ifdef PPU_SIMD_SSE2
+			__m128i pix = _mm_or_si128(
+				_mm_and_si128(ExpandPlane(sprite_shifter_pattern_lo[i], 0), _mm_set1_epi8(0x01)),
+				_mm_and_si128(ExpandPlane(sprite_shifter_pattern_hi[i], 0), _mm_set1_epi8(0x02)));
+			__m128i clear = _mm_cmpeq_epi8(pix, _mm_setzero_si128());
+			__m128i v = _mm_or_si128(pix, _mm_set1_epi8((char)tag));
+			v = _mm_or_si128(_mm_and_si128(clear, _mm_loadl_epi64((__m128i*)p)), _mm_andnot_si128(clear, v));
+			_mm_storel_epi64((__m128i*)p, v);
+#else
+			for (int x = 0; x < 8; x++)
+			{
+				uint8_t bit = 0x80 >> x;
+				uint8_t pix = ((sprite_shifter_pattern_lo[i] & bit) ? 0x01 : 0)
+					| ((sprite_shifter_pattern_hi[i] & bit) ? 0x02 : 0);
+				if (pix != 0) p[x] = tag | pix;
+			}
+#endif
+		}
+	}
+
+	// A sprite is drawn where it is opaque, unless it is behind opaque
+	// background. Sprite zero hits where it is over opaque background,
+	// other than in the leftmost 8 pixels.
+	uint32_t nHit = 0;
+	const uint8_t* pBg = &bg[fine_x];
+
+#if defined(PPU_SIMD_AVX2)
+	for (int x = 0; x < 256; x += 32)
+	{
+		__m256i b = _mm256_loadu_si256((const __m256i*)&pBg[x]);
+		__m256i s = _mm256_load_si256((const __m256i*)&fg[x]);
+
+		__m256i bgClear = _mm256_cmpeq_epi8(_mm256_and_si256(b, _mm256_set1_epi8(0x03)), _mm256_setzero_si256());
+		__m256i fgOpaque = _mm256_cmpeq_epi8(_mm256_and_si256(s, _mm256_set1_epi8(0x10)), _mm256_set1_epi8(0x10));
+		__m256i fgBehind = _mm256_cmpeq_epi8(_mm256_and_si256(s, _mm256_set1_epi8(0x40)), _mm256_set1_epi8(0x40));
+		__m256i useFg = _mm256_andnot_si256(_mm256_andnot_si256(bgClear, fgBehind), fgOpaque);
+
+		__m256i v = _mm256_or_si256(
+			_mm256_and_si256(useFg, _mm256_and_si256(s, _mm256_set1_epi8(0x1F))),
+			_mm256_andnot_si256(useFg, _mm256_andnot_si256(bgClear, b)));
+		_mm256_storeu_si256((__m256i*)&pIndex[x], v);
+
+		uint32_t nMask = (uint32_t)_mm256_movemask_epi8(_mm256_andnot_si256(bgClear, s));
+		nHit |= (x == 0) ? (nMask & 0xFFFFFF00) : nMask;
+	}
+#elif defined(PPU_SIMD_SSE2)
+	for (int x = 0; x < 256; x += 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i*)&pBg[x]);
+		__m128i s = _mm_load_si128((const __m128i*)&fg[x]);
+
+		__m128i bgClear = _mm_cmpeq_epi8(_mm_and_si128(b, _mm_set1_epi8(0x03)), _mm_setzero_si128());
+		__m128i fgOpaque = _mm_cmpeq_epi8(_mm_and_si128(s, _mm_set1_epi8(0x10)), _mm_set1_epi8(0x10));
+		__m128i fgBehind = _mm_cmpeq_epi8(_mm_and_si128(s, _mm_set1_epi8(0x40)), _mm_set1_epi8(0x40));
+		__m128i useFg = _mm_andnot_si128(_mm_andnot_si128(bgClear, fgBehind), fgOpaque);
+
+		__m128i v = _mm_or_si128(
+			_mm_and_si128(useFg, _mm_and_si128(s, _mm_set1_epi8(0x1F))),
+			_mm_andnot_si128(useFg, _mm_andnot_si128(bgClear, b)));
+		_mm_storeu_si128((__m128i*)&pIndex[x], v);
+
+		uint32_t nMask = (uint32_t)_mm_movemask_epi8(_mm_andnot_si128(bgClear, s));
+		nHit |= (x == 0) ? (nMask & 0xFF00) : nMask;
+	}
+#else
+	for (int x = 0; x < 256; x++)
+	{
+		uint8_t b = (pBg[x] & 0x03) ? pBg[x] : 0x00;
+		uint8_t s = fg[x];
 
+		if (s != 0 && !(b != 0 && (s & 0x40)))
+			pIndex[x] = s & 0x1F;
+		else
+			pIndex[x] = b;
+
+		if (x >= 8 && b != 0 && (s & 0x80))
+			nHit = 1;
+	}
+#endif
+
+	return nHit != 0;
+}
+
+// A whole scanline outside of rendering. The PPU state does not change at
+// all through these lines, so a single dot's composition stands for them all.
+void olc2C02::IdleScanline()
+{
+	if (scanline == 241)
+	{
+		status.vertical_blank = 1;
+
+		if (control.enable_nmi)
+		{
+			pScheduler->Raise(Scheduler::NMI);
+		}
+	}
+
+	uint8_t pixel = 0x00;
+	uint8_t palette = 0x00;
+	cycle = 9;
+	ComposePixel(pixel, palette);
+
+	cycle = 0;
+	scanline++;
+	if (scanline >= 261)
+	{
+		scanline = -1;
+		frame_complete = true;
+		odd_frame = !odd_frame;
+	}
+}
+
+void olc2C02::clock()
+{
 		if (scanline >= -1 && scanline < 240)
 		{
 			if (scanline == 0 && cycle == 0 && odd_frame && (mask.render_background || mask.render_sprites))
@@ -574,147 +1306,14 @@ void olc2C02::clock()
 			}
 
 			// Foreground Rendering
-			if (cycle == 257 && scanline >= 0) // Simplified for understanding. The real NES does not do it like this.
+			if (cycle == 257 && scanline >= 0)
 			{
-				// PPU loads sprite information succesively during the region that background tiles are not being drawn.
-				// This implementation does all sprite evaluation in one go.
-
-				std::memset(spriteScanline, 0xFF, 8 * sizeof(sObjectAttributeEntry));
-
-				sprite_count = 0;
-
-				for (uint8_t i = 0; i < 8; i++)
-				{
-					sprite_shifter_pattern_hi[i] = 0;
-					sprite_shifter_pattern_lo[i] = 0;
-				}
-
-				uint8_t nOAMEntry = 0;
-
-				bSpriteZeroHitPossible = false;
-
-				while (nOAMEntry < 64 && sprite_count < 9)
-				{
-					int16_t diff = ((int16_t)scanline - (int16_t)OAM[nOAMEntry].y);
-
-					if (diff >= 0 && diff < (control.sprite_size ? 16 : 8))
-					{
-						if (sprite_count < 8)
-						{
-							if (nOAMEntry == 0)
-							{
-								bSpriteZeroHitPossible = true;
-							}
-
-							memcpy(&spriteScanline[sprite_count], &OAM[nOAMEntry], sizeof(sObjectAttributeEntry));
-							sprite_count++;
-						}
-					}
-
-					nOAMEntry++;
-				}
-
-				status.sprite_overflow = (sprite_count > 8);
+				EvaluateSprites();
 			}
 
 			if (cycle == 340)
 			{
-				for (uint8_t i = 0; i < sprite_count; i++)
-				{
-					uint8_t sprite_pattern_bits_lo, sprite_pattern_bits_hi;
-					uint16_t sprite_pattern_addr_lo, sprite_pattern_addr_hi;
-
-					if (!control.sprite_size)
-					{
-						if (!(spriteScanline[i].attribute & 0x80))
-						{
-							sprite_pattern_addr_lo =
-								(control.pattern_sprite << 12)
-								| (spriteScanline[i].id << 4)
-								| (scanline - spriteScanline[i].y);
-						}
-						else
-						{
-							sprite_pattern_addr_lo =
-								(control.pattern_sprite << 12)
-								| (spriteScanline[i].id << 4)
-								| (7 - (scanline - spriteScanline[i].y));
-						}
-					}
-					else
-					{
-						// 8x16 Sprite Mode - The sprite attribute determines the pattern table
-						if (!(spriteScanline[i].attribute & 0x80))
-						{
-							// Sprite is NOT flipped vertically, i.e. normal
-							if (scanline - spriteScanline[i].y < 8)
-							{
-								// Reading Top half Tile
-								sprite_pattern_addr_lo =
-									((spriteScanline[i].id & 0x01) << 12)  // Which Pattern Table? 0KB or 4KB offset
-									| ((spriteScanline[i].id & 0xFE) << 4)  // Which Cell? Tile ID * 16 (16 bytes per tile)
-									| ((scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
-							}
-							else
-							{
-								// Reading Bottom Half Tile
-								sprite_pattern_addr_lo =
-									((spriteScanline[i].id & 0x01) << 12)  // Which Pattern Table? 0KB or 4KB offset
-									| (((spriteScanline[i].id & 0xFE) + 1) << 4)  // Which Cell? Tile ID * 16 (16 bytes per tile)
-									| ((scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
-							}
-						}
-						else
-						{
-							// Sprite is flipped vertically, i.e. upside down
-							if (scanline - spriteScanline[i].y < 8)
-							{
-								// Reading Top half Tile
-								sprite_pattern_addr_lo =
-									((spriteScanline[i].id & 0x01) << 12)    // Which Pattern Table? 0KB or 4KB offset
-									| (((spriteScanline[i].id & 0xFE) + 1) << 4)    // Which Cell? Tile ID * 16 (16 bytes per tile)
-									| (7 - (scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
-							}
-							else
-							{
-								// Reading Bottom Half Tile
-								sprite_pattern_addr_lo =
-									((spriteScanline[i].id & 0x01) << 12)    // Which Pattern Table? 0KB or 4KB offset
-									| ((spriteScanline[i].id & 0xFE) << 4)    // Which Cell? Tile ID * 16 (16 bytes per tile)
-									| (7 - (scanline - spriteScanline[i].y) & 0x07); // Which Row in cell? (0->7)
-							}
-						}
-					}
-
-					sprite_pattern_addr_hi = sprite_pattern_addr_lo + 8;
-
-					sprite_pattern_bits_lo = ppuRead(sprite_pattern_addr_lo);
-					sprite_pattern_bits_hi = ppuRead(sprite_pattern_addr_hi);
-
-					if (spriteScanline[i].attribute & 0x40)
-					{
-						// This little lambda function "flips" a byte
-						// so 0b11100000 becomes 0b00000111. It's very
-						// clever, and stolen completely from here:
-						// https://stackoverflow.com/a/2602885
-						auto flipbyte = [](uint8_t b)
-							{
-								b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-								b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-								b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-								return b;
-							};
-
-						// Flip Patterns Horizontally
-						sprite_pattern_bits_lo = flipbyte(sprite_pattern_bits_lo);
-						sprite_pattern_bits_hi = flipbyte(sprite_pattern_bits_hi);
-					}
-
-					// Finally! We can load the pattern into our sprite shift registers
-					// ready for rendering on the next scanline
-					sprite_shifter_pattern_lo[i] = sprite_pattern_bits_lo;
-					sprite_shifter_pattern_hi[i] = sprite_pattern_bits_hi;
-				}
+				FetchSprites();
 			}
 		}
 
@@ -732,114 +1331,17 @@ void olc2C02::clock()
 
 				if (control.enable_nmi)
 				{
-					nmi = true;
-				}
-			}
-		}
-
-		uint8_t bg_pixel = 0x00;
-		uint8_t bg_palette = 0x00;
-
-		if (mask.render_background)
-		{
-			uint16_t bit_mux = 0x8000 >> fine_x;
-
-			uint8_t p0_pixel = (bg_shifter_pattern_lo & bit_mux) > 0;
-			uint8_t p1_pixel = (bg_shifter_pattern_hi & bit_mux) > 0;
-
-			bg_pixel = (p1_pixel << 1) | p0_pixel;
-
-			uint8_t bg_pal0 = (bg_shifter_attrib_lo & bit_mux) > 0;
-			uint8_t bg_pal1 = (bg_shifter_attrib_hi & bit_mux) > 0;
-			bg_palette = (bg_pal1 << 1) | bg_pal0;
-		}
-
-		uint8_t fg_pixel = 0x00;
-		uint8_t fg_palette = 0x00;
-		uint8_t fg_priority = 0x00;
-
-		if (mask.render_sprites)
-		{
-			bSpriteZeroBeingRendered = false;
-
-			for (uint8_t i = 0; i < sprite_count; i++)
-			{
-				if (spriteScanline[i].x == 0)
-				{
-					uint8_t fg_pixel_lo = (sprite_shifter_pattern_lo[i] & 0x80) > 0;
-					uint8_t fg_pixel_hi = (sprite_shifter_pattern_hi[i] & 0x80) > 0;
-					fg_pixel = (fg_pixel_hi << 1) | fg_pixel_lo;
-
-					fg_palette = (spriteScanline[i].attribute & 0x03) + 0x04;
-					fg_priority = (spriteScanline[i].attribute & 0x20) == 0;
-
-					if (fg_pixel != 0)
-					{
-						if (i == 0)
-						{
-							bSpriteZeroBeingRendered = true;
-						}
-						break;
-					}
+					pScheduler->Raise(Scheduler::NMI);
 				}
 			}
 		}
 
 		uint8_t pixel = 0x00;
 		uint8_t palette = 0x00;
+		ComposePixel(pixel, palette);
 
-
-		if (bg_pixel == 0 && fg_pixel == 0)
-		{
-			pixel = 0x00;
-			palette = 0x00;
-		}
-		else if (bg_pixel == 0 && fg_pixel > 0)
-		{
-			pixel = fg_pixel;
-			palette = fg_palette;
-		}
-		else if (bg_pixel > 0 && fg_pixel == 0)
-		{
-			pixel = bg_pixel;
-			palette = bg_palette;
-		}
-		else if (bg_pixel > 0 && fg_pixel > 0)
-		{
-			if (fg_priority)
-			{
-				pixel = fg_pixel;
-				palette = fg_palette;
-			}
-			else
-			{
-				pixel = bg_pixel;
-				palette = bg_palette;
-			}
-
-			if (bSpriteZeroHitPossible && bSpriteZeroBeingRendered)
-			{
-				if (mask.render_background & mask.render_sprites)
-				{
-					if (~(mask.render_background_left | mask.render_sprites_left))
-					{
-						if (cycle >= 9 && cycle < 258)
-						{
-							status.sprite_zero_hit = 1;
-						}
-					}
-					else
-					{
-						if (cycle >= 1 && cycle < 258)
-						{
-							status.sprite_zero_hit = 1;
-						}
-					}
-				}
-			}
-		}
-
-		sprScreen->SetPixel(cycle - 1, scanline, GetColourFromPaletteRam(palette, pixel));
+		if (cycle >= 1 && cycle <= 256 && scanline >= 0 && scanline < 240)
+			screenIndex[scanline * 256 + cycle - 1] = GetIndexFromPaletteRam(palette, pixel);
 
 		cycle++;
 
@@ -2,9 +2,11 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "Cartridge.h"
-#include "olcPixelGameEngine.h"
+#include "SaveState.h"
+#include "Scheduler.h"
 
 class olc2C02
 {
@@ -12,6 +14,49 @@ public:
 	olc2C02();
 	~olc2C02();
 
+	// The PPU renders into its own minimal image types so the emulation core
+	// does not depend on a windowing engine. The memory layout of a Pixel
+	// matches olc::Pixel (r, g, b, a), so a front end can copy a Sprite
+	// straight into an olc::Sprite.
+	struct Pixel
+	{
+		uint8_t r = 0x00;
+		uint8_t g = 0x00;
+		uint8_t b = 0x00;
+		uint8_t a = 0xFF;
+
+		Pixel() = default;
+		Pixel(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha = 0xFF) : r(red), g(green), b(blue), a(alpha) {}
+	};
+
+	struct Sprite
+	{
+		Sprite(int32_t w, int32_t h) : width(w), height(h), pColData(w * h) {}
+
+		int32_t width = 0;
+		int32_t height = 0;
+		std::vector<Pixel> pColData;
+
+		bool SetPixel(int32_t x, int32_t y, Pixel p)
+		{
+			if (x >= 0 && x < width && y >= 0 && y < height)
+			{
+				pColData[y * width + x] = p;
+				return true;
+			}
+			return false;
+		}
+
+		Pixel GetPixel(int32_t x, int32_t y) const
+		{
+			if (x >= 0 && x < width && y >= 0 && y < height)
+				return pColData[y * width + x];
+			return Pixel(0, 0, 0, 0);
+		}
+
+		Pixel* GetData() { return pColData.data(); }
+	};
+
 	// Communications with Main Bus
 	uint8_t		cpuRead(uint16_t addr, bool rdonly = false);
 	void		cpuWrite(uint16_t addr, uint8_t data);
@@ -22,34 +67,69 @@ public:
 
 	// Interface
 	void ConnectCartridge(const std::shared_ptr<Cartridge>& cartridge);
+	void MapNameTables(); // The cartridge's mirroring has changed
+	void ConnectScheduler(Scheduler* scheduler) { pScheduler = scheduler; } // NMIs are raised here
 	void clock();
+	void run(uint32_t nDots); // As clock() nDots times, drawing whole scanlines where it can
 	void reset();
 
-	bool nmi = false;
+	// Number of clock() calls before the PPU processes the given dot. Used
+	// to predict when the PPU will next do something the rest of the system
+	// must observe, e.g. raise an NMI. The odd frame dot skip is always
+	// assumed, so this may be one early but is never late.
+	uint32_t DotsUntil(int16_t nScanline, int16_t nCycle) const;
+
+	// Number of clock() calls before the PPU processes the dot on which its
+	// pattern fetches next take address line A12 from low to high, which is
+	// what MMC3 counts scanlines by. Exact, assuming the control and mask
+	// registers are left alone in the meantime. UINT32_MAX if there will be
+	// no such edge, as rendering is off or both kinds of fetch use the same
+	// pattern table.
+	uint32_t DotsUntilA12() const;
+
+	// Registers, memory, rendering state and the frame drawn so far
+	void saveState(StateWriter& state, bool bScreen) const;
+	void loadState(StateReader& state, bool bScreen);
+
 	bool scanline_trigger = false;
 
+	// The frame is drawn as a byte per pixel, the 6-bit NES colour, and only
+	// turned into RGBA when asked for. Anything happy with colour indices,
+	// e.g. hashing frames, never needs to convert them.
+	const uint8_t* GetScreenIndices() const; // 256x240
+	void ConvertScreen(const uint8_t* pIndices, Pixel* pOut) const;
+	const Pixel& GetColourFromIndex(uint8_t index) const { return palScreen[index & 0x3F]; }
+
 	// Debugging Utilities
-	olc::Sprite& GetScreen();
-	olc::Sprite& GetNameTable(uint8_t i);
-	olc::Sprite& GetPatternTable(uint8_t i, uint8_t palette);
-	olc::Pixel& GetColourFromPaletteRam(uint8_t palette, uint8_t pixel);
+	Sprite& GetScreen(); // The current frame, converted to RGBA
+	Sprite& GetNameTable(uint8_t i);
+	Sprite& GetPatternTable(uint8_t i, uint8_t palette);
+	Pixel& GetColourFromPaletteRam(uint8_t palette, uint8_t pixel);
+	uint8_t GetIndexFromPaletteRam(uint8_t palette, uint8_t pixel);
 	bool frame_complete = false;
 
-	uint8_t tblName[2][1024]; // VRAM Name Table
-	uint8_t tblPalette[32]; // RAM Palettes
-	uint8_t tblPattern[2][4096];
+	uint8_t tblName[2][1024] = { 0 }; // VRAM Name Table
+	uint8_t tblPalette[32] = { 0 }; // RAM Palettes
+	uint8_t tblPattern[2][4096] = { 0 };
 
-	// OAM is convenient to work with but the DMA mechanism will need access to it for writing one byte at a time.
+	// OAM is convenient to work with but the DMA mechanism needs access to it as plain bytes.
 	uint8_t* pOAM = (uint8_t*)OAM;
 
 private:
 	// Cartridge or "GamePak"
 	std::shared_ptr<Cartridge> cart;
 
-	olc::Pixel palScreen[0x40];
-	olc::Sprite* sprScreen;
-	olc::Sprite* sprNameTable[2];
-	olc::Sprite* sprPatternTable[2];
+	// The 1KB of memory at each of 0x2000, 0x2400, 0x2800 and 0x2C00, as the
+	// cartridge mirrors them. Nametables are read twice for every tile drawn,
+	// so the mirroring is worked out when it changes, not on every access.
+	uint8_t* pNameTable[4] = { tblName[0], tblName[0], tblName[1], tblName[1] };
+	Scheduler* pScheduler = nullptr;
+
+	Pixel palScreen[0x40];
+	uint8_t screenIndex[256 * 240];
+	Sprite* sprScreen;
+	Sprite* sprNameTable[2];
+	Sprite* sprPatternTable[2];
 
 	union
 	{
@@ -61,7 +141,7 @@ private:
 			uint8_t vertical_blank : 1;
 		};
 
-		uint8_t reg;
+		uint8_t reg = 0x00;
 	} status;
 
 	union
@@ -78,7 +158,7 @@ private:
 			uint8_t enhance_blue : 1;
 		};
 
-		uint8_t reg;
+		uint8_t reg = 0x00;
 	} mask;
 
 	union PPUCTRL
@@ -95,7 +175,7 @@ private:
 			uint8_t enable_nmi : 1;
 		};
 
-		uint8_t reg;
+		uint8_t reg = 0x00;
 	} control;
 
 	union loopy_register
@@ -146,19 +226,40 @@ private:
 		uint8_t id; // ID of tile from pattern memory
 		uint8_t attribute; // Flags define how sprite should be rendered
 		uint8_t x; // X position of sprite
-	} OAM[64];
+	} OAM[64] = {};
 
 	// Register to store address when the CPU manually communicates with OAM via PPU registers.
 	// This is very slow and a 256-byte DMA transfer is used instead.
 	uint8_t oam_addr = 0x00;
 
-	sObjectAttributeEntry spriteScanline[8];
-	uint8_t sprite_count;
-	uint8_t sprite_shifter_pattern_lo[8];
-	uint8_t sprite_shifter_pattern_hi[8];
+	sObjectAttributeEntry spriteScanline[8] = {};
+	uint8_t sprite_count = 0;
+	uint8_t sprite_shifter_pattern_lo[8] = { 0 };
+	uint8_t sprite_shifter_pattern_hi[8] = { 0 };
 
 	// Sprite Zero Collision Flags
 	bool bSpriteZeroHitPossible = false;
 	bool bSpriteZeroBeingRendered = false;
+
+	// Steps of rendering shared by the dot and scanline renderers
+	void IncrementScrollX();
+	void IncrementScrollY();
+	void TransferAddressX();
+	void TransferAddressY();
+	void LoadBackgroundShifters();
+	void UpdateShifters();
+	void EvaluateSprites();
+	void FetchSprites();
+	void ComposePixel(uint8_t& pixel, uint8_t& palette);
+
+	// Scanline renderer, and what it looks up before drawing any lines
+	void PrepareScanlines();
+	void FetchBackground();
+	void RenderScanline();
+	bool ComposeScanline(const uint8_t* bg, uint8_t* pIndex);
+	void IdleScanline();
+	const TileCache::sRow* const* pLineTiles = nullptr;
+	const TileCache::sRow* pLineTileRow = nullptr; // Row of the tile being fetched
+	uint8_t lineIndex[32];
 };
 
@@ -1,32 +1,30 @@
 #include "olc6502.h"
-#include "Bus.h"
+#include "bus.h"
+#include "OpcodeTable.h"
 
 // Datasheet: http://archive.6502.org/datasheets/rockwell_r650x_r651x.pdf
 
-olc6502::olc6502()
+olc6502::olc6502() = default;
+
+// The instruction table is fixed, so it is built by the compiler rather than
+// by every CPU that gets constructed, from the list in OpcodeTable.h. Each
+// entry is the operation, addressing mode and base cycle count of one opcode,
+// the mnemonics are kept apart in 'mnemonic' below as only the disassembler
+// needs them.
+using a = olc6502;
+constexpr olc6502::INSTRUCTION olc6502::lookup[256] =
 {
-	// Initializer list of Initializer Lists
-	using a = olc6502;
-	lookup =
-	{
-		{ "BRK", &a::BRK, &a::IMM, 7 },{ "ORA", &a::ORA, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::ZP0, 3 },{ "ASL", &a::ASL, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PHP", &a::PHP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::IMM, 2 },{ "ASL", &a::ASL, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ABS, 4 },{ "ASL", &a::ASL, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BPL", &a::BPL, &a::REL, 2 },{ "ORA", &a::ORA, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ZPX, 4 },{ "ASL", &a::ASL, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLC", &a::CLC, &a::IMP, 2 },{ "ORA", &a::ORA, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ABX, 4 },{ "ASL", &a::ASL, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "JSR", &a::JSR, &a::ABS, 6 },{ "AND", &a::AND, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "BIT", &a::BIT, &a::ZP0, 3 },{ "AND", &a::AND, &a::ZP0, 3 },{ "ROL", &a::ROL, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PLP", &a::PLP, &a::IMP, 4 },{ "AND", &a::AND, &a::IMM, 2 },{ "ROL", &a::ROL, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "BIT", &a::BIT, &a::ABS, 4 },{ "AND", &a::AND, &a::ABS, 4 },{ "ROL", &a::ROL, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BMI", &a::BMI, &a::REL, 2 },{ "AND", &a::AND, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "AND", &a::AND, &a::ZPX, 4 },{ "ROL", &a::ROL, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SEC", &a::SEC, &a::IMP, 2 },{ "AND", &a::AND, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "AND", &a::AND, &a::ABX, 4 },{ "ROL", &a::ROL, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "RTI", &a::RTI, &a::IMP, 6 },{ "EOR", &a::EOR, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "EOR", &a::EOR, &a::ZP0, 3 },{ "LSR", &a::LSR, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PHA", &a::PHA, &a::IMP, 3 },{ "EOR", &a::EOR, &a::IMM, 2 },{ "LSR", &a::LSR, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "JMP", &a::JMP, &a::ABS, 3 },{ "EOR", &a::EOR, &a::ABS, 4 },{ "LSR", &a::LSR, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BVC", &a::BVC, &a::REL, 2 },{ "EOR", &a::EOR, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "EOR", &a::EOR, &a::ZPX, 4 },{ "LSR", &a::LSR, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLI", &a::CLI, &a::IMP, 2 },{ "EOR", &a::EOR, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "EOR", &a::EOR, &a::ABX, 4 },{ "LSR", &a::LSR, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "RTS", &a::RTS, &a::IMP, 6 },{ "ADC", &a::ADC, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "ADC", &a::ADC, &a::ZP0, 3 },{ "ROR", &a::ROR, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PLA", &a::PLA, &a::IMP, 4 },{ "ADC", &a::ADC, &a::IMM, 2 },{ "ROR", &a::ROR, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "JMP", &a::JMP, &a::IND, 5 },{ "ADC", &a::ADC, &a::ABS, 4 },{ "ROR", &a::ROR, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BVS", &a::BVS, &a::REL, 2 },{ "ADC", &a::ADC, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "ADC", &a::ADC, &a::ZPX, 4 },{ "ROR", &a::ROR, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SEI", &a::SEI, &a::IMP, 2 },{ "ADC", &a::ADC, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "ADC", &a::ADC, &a::ABX, 4 },{ "ROR", &a::ROR, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "???", &a::NOP, &a::IMP, 2 },{ "STA", &a::STA, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "STY", &a::STY, &a::ZP0, 3 },{ "STA", &a::STA, &a::ZP0, 3 },{ "STX", &a::STX, &a::ZP0, 3 },{ "???", &a::XXX, &a::IMP, 3 },{ "DEY", &a::DEY, &a::IMP, 2 },{ "???", &a::NOP, &a::IMP, 2 },{ "TXA", &a::TXA, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "STY", &a::STY, &a::ABS, 4 },{ "STA", &a::STA, &a::ABS, 4 },{ "STX", &a::STX, &a::ABS, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-		{ "BCC", &a::BCC, &a::REL, 2 },{ "STA", &a::STA, &a::IZY, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "STY", &a::STY, &a::ZPX, 4 },{ "STA", &a::STA, &a::ZPX, 4 },{ "STX", &a::STX, &a::ZPY, 4 },{ "???", &a::XXX, &a::IMP, 4 },{ "TYA", &a::TYA, &a::IMP, 2 },{ "STA", &a::STA, &a::ABY, 5 },{ "TXS", &a::TXS, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 5 },{ "???", &a::NOP, &a::IMP, 5 },{ "STA", &a::STA, &a::ABX, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "???", &a::XXX, &a::IMP, 5 },
-		{ "LDY", &a::LDY, &a::IMM, 2 },{ "LDA", &a::LDA, &a::IZX, 6 },{ "LDX", &a::LDX, &a::IMM, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "LDY", &a::LDY, &a::ZP0, 3 },{ "LDA", &a::LDA, &a::ZP0, 3 },{ "LDX", &a::LDX, &a::ZP0, 3 },{ "???", &a::XXX, &a::IMP, 3 },{ "TAY", &a::TAY, &a::IMP, 2 },{ "LDA", &a::LDA, &a::IMM, 2 },{ "TAX", &a::TAX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "LDY", &a::LDY, &a::ABS, 4 },{ "LDA", &a::LDA, &a::ABS, 4 },{ "LDX", &a::LDX, &a::ABS, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-		{ "BCS", &a::BCS, &a::REL, 2 },{ "LDA", &a::LDA, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 5 },{ "LDY", &a::LDY, &a::ZPX, 4 },{ "LDA", &a::LDA, &a::ZPX, 4 },{ "LDX", &a::LDX, &a::ZPY, 4 },{ "???", &a::XXX, &a::IMP, 4 },{ "CLV", &a::CLV, &a::IMP, 2 },{ "LDA", &a::LDA, &a::ABY, 4 },{ "TSX", &a::TSX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 4 },{ "LDY", &a::LDY, &a::ABX, 4 },{ "LDA", &a::LDA, &a::ABX, 4 },{ "LDX", &a::LDX, &a::ABY, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-		{ "CPY", &a::CPY, &a::IMM, 2 },{ "CMP", &a::CMP, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "CPY", &a::CPY, &a::ZP0, 3 },{ "CMP", &a::CMP, &a::ZP0, 3 },{ "DEC", &a::DEC, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "INY", &a::INY, &a::IMP, 2 },{ "CMP", &a::CMP, &a::IMM, 2 },{ "DEX", &a::DEX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "CPY", &a::CPY, &a::ABS, 4 },{ "CMP", &a::CMP, &a::ABS, 4 },{ "DEC", &a::DEC, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BNE", &a::BNE, &a::REL, 2 },{ "CMP", &a::CMP, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "CMP", &a::CMP, &a::ZPX, 4 },{ "DEC", &a::DEC, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLD", &a::CLD, &a::IMP, 2 },{ "CMP", &a::CMP, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "CMP", &a::CMP, &a::ABX, 4 },{ "DEC", &a::DEC, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-		{ "CPX", &a::CPX, &a::IMM, 2 },{ "SBC", &a::SBC, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "CPX", &a::CPX, &a::ZP0, 3 },{ "SBC", &a::SBC, &a::ZP0, 3 },{ "INC", &a::INC, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "INX", &a::INX, &a::IMP, 2 },{ "SBC", &a::SBC, &a::IMM, 2 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::SBC, &a::IMP, 2 },{ "CPX", &a::CPX, &a::ABS, 4 },{ "SBC", &a::SBC, &a::ABS, 4 },{ "INC", &a::INC, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-		{ "BEQ", &a::BEQ, &a::REL, 2 },{ "SBC", &a::SBC, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "SBC", &a::SBC, &a::ZPX, 4 },{ "INC", &a::INC, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SED", &a::SED, &a::IMP, 2 },{ "SBC", &a::SBC, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "SBC", &a::SBC, &a::ABX, 4 },{ "INC", &a::INC, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-	};
-}
+#define X(operate, addrmode, cycles, name) { &a::operate, &a::addrmode, cycles },
+	OPCODE_TABLE_6502(X)
+#undef X
+};
+
+const char* const olc6502::mnemonic[256] =
+{
+#define X(operate, addrmode, cycles, name) name,
+	OPCODE_TABLE_6502(X)
+#undef X
+};
 
 olc6502::~olc6502() = default;
 
@@ -62,24 +60,67 @@ void olc6502::clock()
 {
 	if (cycles == 0)
 	{
-		opcode = read(pc);
-		pc++;
-
-		// Get number of totsl cycles
-		cycles = lookup[opcode].cycles;
+		cycles = step();
+	}
 
-		// Perofrm fetch of intermediate data using the required addressing mode
-		uint8_t additional_cycle1 = (this->*lookup[opcode].addrmode)();
+	cycles--;
+}
 
-		// Perform operation
-		uint8_t additional_cycle2 = (this->*lookup[opcode].operate)();
+// Perform a whole instruction in one go. The instruction is executed in its
+// entirety, exactly as clock() does on its first cycle, but rather than leaving
+// the remaining cycles to be burnt one clock at a time the total is handed back
+// to the caller, which can then advance the rest of the system in bulk.
+uint8_t olc6502::step()
+{
+	// IRQ held by a device is taken as soon as interrupts are enabled, in
+	// place of the next instruction
+	if (irq_line && GetFlag(I) == 0)
+	{
+		interrupt(0xFFFE);
+		return 7;
+	}
 
-		// Address Mode and Operate may have altered the number of cycles this instruction requires before its completed
-		cycles += (additional_cycle1 & additional_cycle2);
+	opcode = read(pc);
+	pc++;
 
+	// Every opcode has its own specialisation of execute(), so the switch
+	// jumps straight into code with the addressing mode and operation inlined
+	switch (opcode)
+	{
+#define OPCODE(n) case n: return execute<lookup[n].operate, lookup[n].addrmode, lookup[n].cycles>();
+#define OPCODE_ROW(h) \
+	OPCODE(h##0) OPCODE(h##1) OPCODE(h##2) OPCODE(h##3) OPCODE(h##4) OPCODE(h##5) OPCODE(h##6) OPCODE(h##7) \
+	OPCODE(h##8) OPCODE(h##9) OPCODE(h##A) OPCODE(h##B) OPCODE(h##C) OPCODE(h##D) OPCODE(h##E) OPCODE(h##F)
+		OPCODE_ROW(0x0) OPCODE_ROW(0x1) OPCODE_ROW(0x2) OPCODE_ROW(0x3)
+		OPCODE_ROW(0x4) OPCODE_ROW(0x5) OPCODE_ROW(0x6) OPCODE_ROW(0x7)
+		OPCODE_ROW(0x8) OPCODE_ROW(0x9) OPCODE_ROW(0xA) OPCODE_ROW(0xB)
+		OPCODE_ROW(0xC) OPCODE_ROW(0xD) OPCODE_ROW(0xE) OPCODE_ROW(0xF)
+#undef OPCODE_ROW
+#undef OPCODE
 	}
 
-	cycles--;
+	return 0;
+}
+
+// The body of a single opcode, with everything about it known at compile time
+template<uint8_t(olc6502::* OPERATE)(void), uint8_t(olc6502::* ADDRMODE)(void), uint8_t CYCLES>
+uint8_t olc6502::execute()
+{
+	// Get number of totsl cycles
+	cycles = CYCLES;
+
+	// Perofrm fetch of intermediate data using the required addressing mode
+	uint8_t additional_cycle1 = (this->*ADDRMODE)();
+
+	// Perform operation
+	uint8_t additional_cycle2 = (this->*OPERATE)();
+
+	// Address Mode and Operate may have altered the number of cycles this instruction requires before its completed
+	cycles += (additional_cycle1 & additional_cycle2);
+
+	uint8_t total_cycles = cycles;
+	cycles = 0;
+	return total_cycles;
 }
 
 // Addressing Modes
@@ -872,24 +913,7 @@ void olc6502::irq() // Interrupt Request
 {
 	if (GetFlag(I) == 0) // If Interrupts are allowed
 	{
-		// Push Program Counter to stack. It takes two pushes since its of 16-bits.
-		write(0x0100 + stkp, (pc >> 8) & 0x00FF);
-		stkp--;
-		write(0x0100 + stkp, pc & 0x00FF);
-		stkp--;
-
-		// Push Status Register to Stack
-		SetFlag(B, 0);
-		SetFlag(U, 1);
-		SetFlag(I, 1);
-		write(0x0100 + stkp, status);
-		stkp--;
-
-		// Read new Program Counter location from the fixed address
-		addr_abs = 0xFFFE;
-		uint16_t lo = read(addr_abs + 0);
-		uint16_t hi = read(addr_abs + 1);
-		pc = (hi << 8) | lo;
+		interrupt(0xFFFE);
 
 		// IRQ time
 		cycles = 7;
@@ -898,23 +922,32 @@ void olc6502::irq() // Interrupt Request
 
 void olc6502::nmi() // Non-maskable Interrupt. Cannot be ignored and behaves the exact same way as IRQ but it reads the new progcpuRAM counter address from location 0xFFFA.
 {
+	interrupt(0xFFFA);
+	cycles = 8;
+}
+
+// Save where the CPU was and go to the handler at the address in nVector
+void olc6502::interrupt(uint16_t nVector)
+{
+	// Push Program Counter to stack. It takes two pushes since its of 16-bits.
 	write(0x0100 + stkp, (pc >> 8) & 0x00FF);
 	stkp--;
 	write(0x0100 + stkp, pc & 0x00FF);
 	stkp--;
 
+	// Push Status Register to Stack, as it was before the interrupt
+	// disabled further ones, so that RTI enables them again
 	SetFlag(B, 0);
 	SetFlag(U, 1);
-	SetFlag(I, 1);
 	write(0x0100 + stkp, status);
 	stkp--;
+	SetFlag(I, 1);
 
-	addr_abs = 0xFFFA;
+	// Read new Program Counter location from the fixed address
+	addr_abs = nVector;
 	uint16_t lo = read(addr_abs + 0);
 	uint16_t hi = read(addr_abs + 1);
 	pc = (hi << 8) | lo;
-
-	cycles = 8;
 }
 
 bool olc6502::complete() const // Indicates a clock cycle has completed
@@ -922,6 +955,24 @@ bool olc6502::complete() const // Indicates a clock cycle has completed
 	return cycles == 0;
 }
 
+void olc6502::saveState(StateWriter& state) const
+{
+	state.Write(accumulator); state.Write(x); state.Write(y);
+	state.Write(stkp); state.Write(pc); state.Write(status);
+
+	state.Write(fetched); state.Write(addr_abs); state.Write(addr_rel);
+	state.Write(opcode); state.Write(cycles); state.Write(clock_count);
+}
+
+void olc6502::loadState(StateReader& state)
+{
+	state.Read(accumulator); state.Read(x); state.Read(y);
+	state.Read(stkp); state.Read(pc); state.Read(status);
+
+	state.Read(fetched); state.Read(addr_abs); state.Read(addr_rel);
+	state.Read(opcode); state.Read(cycles); state.Read(clock_count);
+}
+
 std::map<uint16_t, std::string> olc6502::disassemble(uint16_t nStart, uint16_t nStop) // Debugging disassemblely function.
 {
 	uint32_t addr = nStart;
@@ -950,7 +1001,7 @@ std::map<uint16_t, std::string> olc6502::disassemble(uint16_t nStart, uint16_t n
 		uint8_t opcode = bus->cpuRead(addr, true); // Read instruction and get its name
 		addr++;
 
-		sInst += lookup[opcode].name + " ";
+		sInst += std::string(mnemonic[opcode]) + " ";
 
 		// Get operands from desired locations. They mimic the actual fetch routine of the 6502 to get accurate data as part of the instruction.
 		if (lookup[opcode].addrmode == &olc6502::IMP)
@@ -1,8 +1,10 @@
 #pragma once
-#include <vector>
+#include <cstdint>
 #include <string>
 #include <map>
 
+#include "SaveState.h"
+
 class Bus;
 
 class olc6502
@@ -63,12 +65,21 @@ public:
 	uint8_t XXX(); // Illegal instruction / NOP
 
 	void clock(); // Clock
+	uint8_t step(); // Execute one whole instruction immediately, returning the number of cycles it takes
 	void reset(); // Reset
 	void irq(); // Interrupt Request
 	void nmi(); // Non-maskable Interrupt
 
+	// IRQ is a level. A device holds this while it is interrupting, and the
+	// CPU is interrupted between instructions for as long as it is held with
+	// interrupts enabled, not only when it is first raised.
+	bool irq_line = false;
+
 	bool complete() const; // Indicates that current instruction has completed by returning true. Utility for step-by-step execution without manually clocking every cycle.
 
+	void saveState(StateWriter& state) const; // Registers and the state of the current instruction
+	void loadState(StateReader& state);
+
 	uint8_t fetch(); // Helper Fetch Function
 	uint8_t fetched = 0x00; // Result of fetch()
 
@@ -87,15 +98,19 @@ private:
 
 	uint8_t		GetFlag(FLAGS6502 f) const;
 	void		SetFlag(FLAGS6502 f, bool v);
+	void		interrupt(uint16_t nVector);
 
 	struct INSTRUCTION
 	{
-		std::string name; // Mnemonic
 		uint8_t(olc6502::* operate)(void) = nullptr; // Function pointer to operation/opcode
 		uint8_t(olc6502::* addrmode)(void) = nullptr; // Function Pointer to addressing mode
 		uint8_t cycles = 0; // Number of Cycles required by the instruction
 	};
 
-	std::vector<INSTRUCTION> lookup;
+	static const INSTRUCTION lookup[256]; // Constant, defined in olc6502.cpp
+	static const char* const mnemonic[256]; // Instruction names, for the disassembler
+
+	template<uint8_t(olc6502::* OPERATE)(void), uint8_t(olc6502::* ADDRMODE)(void), uint8_t CYCLES>
+	uint8_t execute(); // Execute one opcode, returning the number of cycles it takes
 
 };
\ No newline at end of file